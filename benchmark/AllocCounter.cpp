@@ -0,0 +1,72 @@
+#include "AllocCounter.h"
+#include <event2/event.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<size_t> allocations = 0;
+thread_local bool   ignored     = false;
+
+void *Allocate( size_t size ) {
+    if ( !ignored ) {
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+    }
+    if ( void *p = std::malloc( size == 0 ? 1 : size ) ) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *CountedMalloc( size_t size ) {
+    if ( !ignored ) {
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+    }
+    return std::malloc( size );
+}
+
+void *CountedRealloc( void *p, size_t size ) {
+    if ( !ignored ) {
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+    }
+    return std::realloc( p, size );
+}
+
+}  // namespace
+
+size_t AllocCounter::Count() {
+    return allocations.load( std::memory_order_relaxed );
+}
+
+void AllocCounter::IgnoreThisThread() {
+    ignored = true;
+}
+
+void AllocCounter::CountLibevent() {
+    event_set_mem_functions( CountedMalloc, CountedRealloc, std::free );
+}
+
+void *operator new( size_t size ) {
+    return Allocate( size );
+}
+
+void *operator new[]( size_t size ) {
+    return Allocate( size );
+}
+
+void operator delete( void *p ) noexcept {
+    std::free( p );
+}
+
+void operator delete[]( void *p ) noexcept {
+    std::free( p );
+}
+
+void operator delete( void *p, size_t ) noexcept {
+    std::free( p );
+}
+
+void operator delete[]( void *p, size_t ) noexcept {
+    std::free( p );
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief Counts heap allocations made through operator new by the benchmark binary
+ * Threads that are not part of the client under test (the stand-in server) opt out, so the count is what the
+ * client and the benchmark driver allocate.
+ */
+class AllocCounter final {
+public:
+    static size_t Count();
+    // stop counting allocations made by the calling thread
+    static void IgnoreThisThread();
+    // count libevent's own malloc / realloc too, before libevent allocates anything
+    static void CountLibevent();
+};
@@ -0,0 +1,189 @@
+#include "BenchServer.h"
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/keyvalq_struct.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+#ifdef BUILD_WITH_SSL
+    #include <event2/bufferevent_ssl.h>
+    #include <openssl/ec.h>
+    #include <openssl/evp.h>
+    #include <openssl/ssl.h>
+    #include <openssl/x509.h>
+#endif
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "AllocCounter.h"
+
+namespace {
+
+struct Delayed {
+    evhttp_request *req;
+    size_t          size;
+    BenchServer    *server;
+};
+
+size_t QueryValue( evhttp_request *req, const char *key, size_t fallback ) {
+    auto *query = evhttp_uri_get_query( evhttp_request_get_evhttp_uri( req ) );
+    if ( query == nullptr ) {
+        return fallback;
+    }
+    evkeyvalq params;
+    if ( evhttp_parse_query_str( query, &params ) != 0 ) {
+        return fallback;
+    }
+    auto  *value  = evhttp_find_header( &params, key );
+    size_t result = value != nullptr ? std::strtoull( value, nullptr, 10 ) : fallback;
+    evhttp_clear_headers( &params );
+    return result;
+}
+
+}  // namespace
+
+BenchServer::BenchServer( const BenchServerOptions &options ) : options_( options ), body_( options.body_size, 'x' ) {
+    // the destructor breaks the loop from another thread, the client's bases are created without locks either way
+    evthread_use_pthreads();
+    base_ = event_base_new();
+    if ( base_ == nullptr ) {
+        throw std::runtime_error( "Failed to create event base" );
+    }
+    http_ = evhttp_new( base_ );
+    if ( http_ == nullptr ) {
+        throw std::runtime_error( "Failed to create evhttp" );
+    }
+    evhttp_set_allowed_methods( http_, EVHTTP_REQ_GET | EVHTTP_REQ_POST );
+    evhttp_set_gencb( http_, OnRequest, this );
+    if ( options_.tls ) {
+        InitTLS();
+    }
+    auto *handle = evhttp_bind_socket_with_handle( http_, "127.0.0.1", 0 );
+    if ( handle == nullptr ) {
+        throw std::runtime_error( "Failed to bind 127.0.0.1" );
+    }
+    sockaddr_storage addr;
+    ev_socklen_t     len = sizeof( addr );
+    getsockname( evhttp_bound_socket_get_fd( handle ), reinterpret_cast<sockaddr *>( &addr ), &len );
+    port_   = ntohs( reinterpret_cast<sockaddr_in *>( &addr )->sin_port );
+    worker_ = std::thread( [this]() {
+        AllocCounter::IgnoreThisThread();
+        event_base_loop( base_, EVLOOP_NO_EXIT_ON_EMPTY );
+    } );
+}
+
+BenchServer::~BenchServer() {
+    if ( worker_.joinable() ) {
+        event_base_loopbreak( base_ );
+        worker_.join();
+    }
+    evhttp_free( http_ );
+    event_base_free( base_ );
+#ifdef BUILD_WITH_SSL
+    SSL_CTX_free( ssl_ );
+#endif
+}
+
+uint16_t BenchServer::Port() const {
+    return port_;
+}
+
+std::string BenchServer::Url() const {
+    return std::string( options_.tls ? "https" : "http" ) + "://127.0.0.1:" + std::to_string( port_ ) + "/";
+}
+
+double BenchServer::CpuSeconds() const {
+    clockid_t clock;
+    timespec  ts;
+    if ( pthread_getcpuclockid( const_cast<std::thread &>( worker_ ).native_handle(), &clock ) != 0 ||
+         clock_gettime( clock, &ts ) != 0 ) {
+        return 0;
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void BenchServer::OnRequest( evhttp_request *req, void *arg ) {
+    auto *server = reinterpret_cast<BenchServer *>( arg );
+    // a TLS reply goes out as several records, Nagle would hold the last one for the client's delayed ACK
+    int   one    = 1;
+    auto *bufev  = evhttp_connection_get_bufferevent( evhttp_request_get_connection( req ) );
+    setsockopt( bufferevent_getfd( bufev ), IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+    size_t size  = QueryValue( req, "size", server->options_.body_size );
+    int    delay = static_cast<int>( QueryValue( req, "delay_ms", server->options_.delay_ms ) );
+    if ( delay <= 0 ) {
+        server->Reply( req, size );
+        return;
+    }
+    timeval tv{ delay / 1000, ( delay % 1000 ) * 1000 };
+    event_base_once(
+        server->base_, -1, EV_TIMEOUT,
+        []( evutil_socket_t, short, void *arg ) {
+            auto *delayed = reinterpret_cast<Delayed *>( arg );
+            delayed->server->Reply( delayed->req, delayed->size );
+            delete delayed;
+        },
+        new Delayed{ req, size, server }, &tv );
+}
+
+void BenchServer::Reply( evhttp_request *req, size_t size ) {
+    if ( size > body_.size() ) {
+        body_.assign( size, 'x' );
+    }
+    auto *headers = evhttp_request_get_output_headers( req );
+    evhttp_add_header( headers, "Content-Type", "application/octet-stream" );
+    if ( !options_.keep_alive ) {
+        evhttp_add_header( headers, "Connection", "close" );
+    }
+    auto *buffer = evbuffer_new();
+    evbuffer_add( buffer, body_.data(), size );
+    evhttp_send_reply( req, 200, "OK", buffer );
+    evbuffer_free( buffer );
+}
+
+void BenchServer::InitTLS() {
+#ifdef BUILD_WITH_SSL
+    ssl_ = SSL_CTX_new( TLS_server_method() );
+    // P-256 key and a self-signed certificate, the client does not verify it
+    auto *key_ctx = EVP_PKEY_CTX_new_id( EVP_PKEY_EC, nullptr );
+    EVP_PKEY *key = nullptr;
+    if ( ssl_ == nullptr || key_ctx == nullptr || EVP_PKEY_keygen_init( key_ctx ) <= 0 ||
+         EVP_PKEY_CTX_set_ec_paramgen_curve_nid( key_ctx, NID_X9_62_prime256v1 ) <= 0 ||
+         EVP_PKEY_keygen( key_ctx, &key ) <= 0 ) {
+        EVP_PKEY_CTX_free( key_ctx );
+        throw std::runtime_error( "Failed to generate TLS key" );
+    }
+    EVP_PKEY_CTX_free( key_ctx );
+    auto *cert = X509_new();
+    X509_set_version( cert, 2 );
+    ASN1_INTEGER_set( X509_get_serialNumber( cert ), 1 );
+    X509_gmtime_adj( X509_getm_notBefore( cert ), 0 );
+    X509_gmtime_adj( X509_getm_notAfter( cert ), 24 * 3600 );
+    X509_set_pubkey( cert, key );
+    auto *name = X509_get_subject_name( cert );
+    X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>( "127.0.0.1" ), -1,
+                                -1, 0 );
+    X509_set_issuer_name( cert, name );
+    bool ok = X509_sign( cert, key, EVP_sha256() ) > 0 && SSL_CTX_use_certificate( ssl_, cert ) == 1 &&
+              SSL_CTX_use_PrivateKey( ssl_, key ) == 1;
+    X509_free( cert );
+    EVP_PKEY_free( key );
+    if ( !ok ) {
+        throw std::runtime_error( "Failed to create TLS certificate" );
+    }
+    evhttp_set_bevcb(
+        http_,
+        []( event_base *base, void *arg ) {
+            auto *ssl = SSL_new( reinterpret_cast<SSL_CTX *>( arg ) );
+            return bufferevent_openssl_socket_new( base, -1, ssl, BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE );
+        },
+        ssl_ );
+#else
+    throw std::runtime_error( "TLS needs BUILD_WITH_SSL" );
+#endif
+}
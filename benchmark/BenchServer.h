@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+struct event_base;
+struct evhttp;
+struct evhttp_request;
+struct ssl_ctx_st;
+
+struct BenchServerOptions {
+    size_t body_size  = 1024;   // default response body size, ?size= overrides it per request
+    int    delay_ms   = 0;      // default time before replying, ?delay_ms= overrides it per request
+    bool   keep_alive = true;   // false: every reply closes its connection
+    bool   tls        = false;  // with a self-signed certificate generated at start
+};
+
+/**
+ * @brief Stand-in HTTP server for the benchmark, libevent evhttp on 127.0.0.1 on a thread of its own
+ * Answers every path with a body of the requested size. It is started on an ephemeral port and its thread is left
+ * out of the allocation count, its CPU time is reported separately.
+ */
+class BenchServer final {
+public:
+    explicit BenchServer( const BenchServerOptions &options );
+    BenchServer( const BenchServer & )            = delete;
+    BenchServer &operator=( const BenchServer & ) = delete;
+    ~BenchServer();
+
+    uint16_t    Port() const;
+    std::string Url() const;  // e.g. http://127.0.0.1:port/
+    double      CpuSeconds() const;  // used by the server thread so far
+
+private:
+    static void OnRequest( evhttp_request *req, void *arg );
+
+    void InitTLS();
+    void Reply( evhttp_request *req, size_t size );
+
+    BenchServerOptions options_;
+    std::string        body_;  // grown to the largest body asked for, server thread only
+    event_base        *base_ = nullptr;
+    evhttp            *http_ = nullptr;
+    ssl_ctx_st        *ssl_  = nullptr;
+    uint16_t           port_ = 0;
+    std::thread        worker_;
+};
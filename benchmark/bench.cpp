@@ -0,0 +1,280 @@
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AllocCounter.h"
+#include "BenchServer.h"
+#include "HttpClient.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct BenchOptions {
+    size_t concurrency = 64;  // requests kept in flight, closed loop
+    double rate        = 0;   // requests per second started on schedule instead, open loop
+    double duration_s  = 5;
+    double warmup_s    = 1;
+    size_t loops       = 1;
+    BenchServerOptions server;
+};
+
+// latencies and failures of one measured run
+class Recorder final {
+public:
+    Recorder() { latencies_us_.reserve( 1 << 22 ); }
+
+    void Add( Clock::duration latency, bool success ) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>( latency ).count();
+        std::lock_guard<std::mutex> lock( mutex_ );
+        latencies_us_.push_back( us );
+        failures_ += success ? 0 : 1;
+    }
+
+    size_t Count() {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return latencies_us_.size();
+    }
+
+    size_t Failures() {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return failures_;
+    }
+
+    // p in [0, 1], nearest rank
+    int64_t Percentile( double p ) {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( latencies_us_.empty() ) {
+            return 0;
+        }
+        std::sort( latencies_us_.begin(), latencies_us_.end() );
+        size_t rank = static_cast<size_t>( std::ceil( p * latencies_us_.size() ) );
+        return latencies_us_[std::clamp<size_t>( rank, 1, latencies_us_.size() ) - 1];
+    }
+
+private:
+    std::mutex           mutex_;
+    std::vector<int64_t> latencies_us_;
+    size_t               failures_ = 0;
+};
+
+// waits for the requests still in flight once a run stops starting new ones
+class InFlight final {
+public:
+    void Add() {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        ++count_;
+    }
+
+    void Done() {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( --count_ == 0 ) {
+            cv_.notify_all();
+        }
+    }
+
+    void Wait() {
+        std::unique_lock<std::mutex> lock( mutex_ );
+        cv_.wait( lock, [this]() { return count_ == 0; } );
+    }
+
+private:
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    size_t                  count_ = 0;
+};
+
+double ProcessCpuSeconds() {
+    rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) / 1e6;
+}
+
+void Send( HttpClient &client, SSLConfig *ssl_config, const HttpRequest &request, HttpResponse::Callback callback ) {
+    if ( ssl_config != nullptr ) {
+        client.Send( request, *ssl_config, std::move( callback ) );
+    }
+    else {
+        client.Send( request, std::move( callback ) );
+    }
+}
+
+// every finished request starts the next one, so concurrency requests are always in flight
+void RunClosedLoop( HttpClient &client, SSLConfig *ssl_config, const HttpRequest &request, size_t concurrency,
+                    Clock::time_point end, Recorder &recorder ) {
+    InFlight                                 in_flight;
+    std::function<void( Clock::time_point )> next;
+    next = [&]( Clock::time_point start ) {
+        Send( client, ssl_config, request, [&, start]( HttpResponse::Ptr response ) {
+            auto now = Clock::now();
+            recorder.Add( now - start, response->IsSuccess() );
+            if ( now < end ) {
+                next( now );
+                return;
+            }
+            in_flight.Done();
+        } );
+    };
+    for ( size_t i = 0; i < concurrency; ++i ) {
+        in_flight.Add();
+        next( Clock::now() );
+    }
+    in_flight.Wait();
+}
+
+// requests are started on a fixed schedule whatever the responses do, latency counts from the scheduled time so a
+// stalled client is not hidden by sending less (coordinated omission)
+void RunOpenLoop( HttpClient &client, SSLConfig *ssl_config, const HttpRequest &request, double rate,
+                  Clock::time_point end, Recorder &recorder ) {
+    InFlight in_flight;
+    auto     interval = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / rate ) );
+    auto     start    = Clock::now();
+    for ( size_t i = 0;; ++i ) {
+        auto scheduled = start + interval * i;
+        if ( scheduled >= end ) {
+            break;
+        }
+        std::this_thread::sleep_until( scheduled );
+        in_flight.Add();
+        Send( client, ssl_config, request, [&, scheduled]( HttpResponse::Ptr response ) {
+            recorder.Add( Clock::now() - scheduled, response->IsSuccess() );
+            in_flight.Done();
+        } );
+    }
+    in_flight.Wait();
+}
+
+void Run( HttpClient &client, SSLConfig *ssl_config, const HttpRequest &request, const BenchOptions &options,
+          double seconds, Recorder &recorder ) {
+    auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( seconds ) );
+    if ( options.rate > 0 ) {
+        RunOpenLoop( client, ssl_config, request, options.rate, end, recorder );
+    }
+    else {
+        RunClosedLoop( client, ssl_config, request, options.concurrency, end, recorder );
+    }
+}
+
+void Usage( const char *name ) {
+    std::printf( "usage: %s [options]\n"
+                 "  --concurrency=N   requests in flight, closed loop (default 64)\n"
+                 "  --rate=R          requests per second on a fixed schedule, open loop (default off)\n"
+                 "  --duration=S      measured seconds (default 5)\n"
+                 "  --warmup=S        seconds run before measuring (default 1)\n"
+                 "  --size=BYTES      response body size (default 1024)\n"
+                 "  --delay-ms=MS     server latency before each reply (default 0)\n"
+                 "  --loops=N         client event loops (default 1)\n"
+                 "  --no-keep-alive   server closes the connection after each reply\n"
+                 "  --tls             HTTPS with a generated self-signed certificate\n",
+                 name );
+}
+
+bool ParseArgs( int argc, char **argv, BenchOptions &options ) {
+    for ( int i = 1; i < argc; ++i ) {
+        std::string arg   = argv[i];
+        auto        eq    = arg.find( '=' );
+        std::string key   = arg.substr( 0, eq );
+        const char *value = eq == std::string::npos ? "" : argv[i] + eq + 1;
+        if ( key == "--concurrency" ) {
+            options.concurrency = std::max<size_t>( std::strtoull( value, nullptr, 10 ), 1 );
+        }
+        else if ( key == "--rate" ) {
+            options.rate = std::atof( value );
+        }
+        else if ( key == "--duration" ) {
+            options.duration_s = std::atof( value );
+        }
+        else if ( key == "--warmup" ) {
+            options.warmup_s = std::atof( value );
+        }
+        else if ( key == "--size" ) {
+            options.server.body_size = std::strtoull( value, nullptr, 10 );
+        }
+        else if ( key == "--delay-ms" ) {
+            options.server.delay_ms = std::atoi( value );
+        }
+        else if ( key == "--loops" ) {
+            options.loops = std::max<size_t>( std::strtoull( value, nullptr, 10 ), 1 );
+        }
+        else if ( key == "--no-keep-alive" ) {
+            options.server.keep_alive = false;
+        }
+        else if ( key == "--tls" ) {
+            options.server.tls = true;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main( int argc, char **argv ) {
+    BenchOptions options;
+    if ( !ParseArgs( argc, argv, options ) ) {
+        Usage( argv[0] );
+        return 1;
+    }
+    BenchServer server( options.server );
+
+    HttpClientOptions client_options;
+    client_options.event_loops       = options.loops;
+    client_options.pool.max_per_host = options.rate > 0 ? 256 : options.concurrency;
+    client_options.pool.max_idle     = client_options.pool.max_per_host * options.loops;
+    HttpClient                 client( client_options );
+    std::unique_ptr<SSLConfig> ssl_config;
+    if ( options.server.tls ) {
+        ssl_config = std::make_unique<SSLConfig>();
+    }
+    HttpRequest request;
+    request.SetFullUrl( server.Url() + "bench" ).SetMethod( HttpRequest::GET );
+
+    if ( options.warmup_s > 0 ) {
+        Recorder warmup;
+        Run( client, ssl_config.get(), request, options, options.warmup_s, warmup );
+    }
+
+    Recorder recorder;
+    auto     allocs_before     = AllocCounter::Count();
+    auto     cpu_before        = ProcessCpuSeconds();
+    auto     server_cpu_before = server.CpuSeconds();
+    auto     start             = Clock::now();
+    Run( client, ssl_config.get(), request, options, options.duration_s, recorder );
+    double elapsed    = std::chrono::duration<double>( Clock::now() - start ).count();
+    double server_cpu = server.CpuSeconds() - server_cpu_before;
+    double client_cpu = ProcessCpuSeconds() - cpu_before - server_cpu;
+    auto   allocs     = AllocCounter::Count() - allocs_before;
+
+    size_t count = std::max<size_t>( recorder.Count(), 1 );
+    char   mode[64];
+    if ( options.rate > 0 ) {
+        std::snprintf( mode, sizeof( mode ), "rate %g/s", options.rate );
+    }
+    else {
+        std::snprintf( mode, sizeof( mode ), "concurrency %zu", options.concurrency );
+    }
+    std::printf( "%s %s, body %zu B, delay %d ms, %s, %zu loop(s)\n", options.server.tls ? "https" : "http",
+                 options.server.keep_alive ? "keep-alive" : "close", options.server.body_size, options.server.delay_ms,
+                 mode, options.loops );
+    std::printf( "requests     %zu (%zu failed) in %.2f s\n", recorder.Count(), recorder.Failures(), elapsed );
+    std::printf( "throughput   %.0f req/s\n", recorder.Count() / elapsed );
+    std::printf( "latency us   p50 %lld  p99 %lld  p999 %lld\n", static_cast<long long>( recorder.Percentile( 0.5 ) ),
+                 static_cast<long long>( recorder.Percentile( 0.99 ) ),
+                 static_cast<long long>( recorder.Percentile( 0.999 ) ) );
+    std::printf( "allocs/req   %.1f (operator new, client and driver)\n", static_cast<double>( allocs ) / count );
+    std::printf( "cpu us/req   %.1f client, %.1f server\n", client_cpu * 1e6 / count, server_cpu * 1e6 / count );
+    return recorder.Failures() == 0 ? 0 : 2;
+}
@@ -0,0 +1,240 @@
+#include <arpa/inet.h>
+#include <event2/dns.h>
+#include <event2/dns_struct.h>
+#include <event2/event.h>
+#include <event2/util.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "AllocCounter.h"
+#include "DnsCache.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct DnsBenchOptions {
+    size_t iterations = 1000000;  // cached lookups measured
+};
+
+/**
+ * @brief Stand-in DNS server on 127.0.0.1, answering A queries from a table and NXDOMAIN for anything else
+ * Runs on the event base of the cache under test, so everything stays on one thread.
+ */
+class StandInResolver final {
+public:
+    explicit StandInResolver( event_base *base ) {
+        socket_ = socket( AF_INET, SOCK_DGRAM, 0 );
+        sockaddr_in addr{};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        socklen_t length     = sizeof( addr );
+        if ( socket_ < 0 || bind( socket_, reinterpret_cast<sockaddr *>( &addr ), sizeof( addr ) ) != 0 ||
+             getsockname( socket_, reinterpret_cast<sockaddr *>( &addr ), &length ) != 0 ) {
+            std::perror( "stand-in resolver" );
+            std::exit( 1 );
+        }
+        evutil_make_socket_nonblocking( socket_ );
+        port_   = ntohs( addr.sin_port );
+        server_ = evdns_add_server_port_with_base( base, socket_, 0, OnRequest, this );
+    }
+    StandInResolver( const StandInResolver & )            = delete;
+    StandInResolver &operator=( const StandInResolver & ) = delete;
+    ~StandInResolver() {
+        evdns_close_server_port( server_ );
+        evutil_closesocket( socket_ );
+    }
+
+    void Set( const std::string &name, const std::string &address, int ttl_s ) { records_[name] = { address, ttl_s }; }
+
+    std::string Address() const { return "127.0.0.1:" + std::to_string( port_ ); }
+    size_t      Queries() const { return queries_; }
+
+private:
+    static void OnRequest( evdns_server_request *request, void *arg ) {
+        auto *self = static_cast<StandInResolver *>( arg );
+        int   error = DNS_ERR_NONE;
+        for ( int i = 0; i < request->nquestions; ++i ) {
+            auto *question = request->questions[i];
+            ++self->queries_;
+            // evdns mixes the case of the names it asks for, DNS 0x20
+            std::string name = question->name;
+            std::transform( name.begin(), name.end(), name.begin(),
+                            []( unsigned char c ) { return static_cast<char>( std::tolower( c ) ); } );
+            auto it = self->records_.find( name );
+            if ( it == self->records_.end() ) {
+                error = DNS_ERR_NOTEXIST;
+                continue;
+            }
+            in_addr address{};
+            inet_pton( AF_INET, it->second.first.c_str(), &address );
+            if ( question->type == EVDNS_TYPE_A ) {
+                evdns_server_request_add_a_reply( request, question->name, 1, &address, it->second.second );
+            }
+        }
+        evdns_server_request_respond( request, error );
+    }
+
+    evutil_socket_t                                    socket_ = -1;
+    uint16_t                                           port_   = 0;
+    evdns_server_port                                 *server_ = nullptr;
+    std::map<std::string, std::pair<std::string, int>> records_;  // name -> address, TTL
+    size_t                                             queries_ = 0;
+};
+
+struct Answer {
+    bool        done = false;
+    std::string address;
+    std::string error;
+};
+
+// runs the loop until every host is answered
+std::vector<Answer> ResolveAll( event_base *base, DnsCache &cache, const std::vector<std::string> &hosts ) {
+    std::vector<Answer> answers( hosts.size() );
+    for ( size_t i = 0; i < hosts.size(); ++i ) {
+        cache.Resolve( hosts[i], [&answer = answers[i]]( const std::string &address, const std::string &error ) {
+            answer = Answer{ true, address, error };
+        } );
+    }
+    while ( !std::all_of( answers.begin(), answers.end(), []( const Answer &answer ) { return answer.done; } ) ) {
+        event_base_loop( base, EVLOOP_ONCE );
+    }
+    return answers;
+}
+
+Answer Resolve( event_base *base, DnsCache &cache, const std::string &host ) {
+    return ResolveAll( base, cache, { host } ).front();
+}
+
+void WriteHostsFile( const std::string &path, const std::string &content ) {
+    std::ofstream( path, std::ios::trunc ) << content;
+}
+
+size_t failures = 0;
+
+void Check( const char *what, bool ok ) {
+    std::printf( "  %-52s %s\n", what, ok ? "ok" : "FAILED" );
+    failures += ok ? 0 : 1;
+}
+
+// the cache against the stand-in resolver and a temporary hosts file, false on any failed check
+bool CheckCache( event_base *base ) {
+    char path[] = "/tmp/dns_bench_hosts_XXXXXX";
+    int  fd     = mkstemp( path );
+    if ( fd < 0 ) {
+        std::perror( "mkstemp" );
+        return false;
+    }
+    close( fd );
+    WriteHostsFile( path, "10.0.0.1 pinned.test  # first line wins\n10.0.0.2 pinned.test other.test\n" );
+
+    StandInResolver resolver( base );
+    resolver.Set( "a.test", "192.0.2.1", 1 );
+    DnsOptions options;
+    options.nameservers = { resolver.Address() };
+    options.hosts_file  = path;
+    options.hosts       = { { "fixed.test", "10.0.0.7" } };
+    options.max_ttl_s   = 1;
+    DnsCache cache( base, options );
+
+    Check( "hosts file, first line wins, any case", Resolve( base, cache, "PINNED.test" ).address == "10.0.0.1" );
+    Check( "hosts file, more names on a line", Resolve( base, cache, "other.test" ).address == "10.0.0.2" );
+    Check( "pinned host", Resolve( base, cache, "fixed.test" ).address == "10.0.0.7" );
+    cache.Seed( "seeded.test", "10.0.0.3", 60 );
+    Check( "seeded entry", Resolve( base, cache, "seeded.test" ).address == "10.0.0.3" );
+    Check( "no query for any of these", resolver.Queries() == 0 );
+
+    auto both = ResolveAll( base, cache, { "a.test", "a.test" } );
+    Check( "concurrent lookups share one query",
+           resolver.Queries() == 1 && both[0].address == "192.0.2.1" && both[1].address == "192.0.2.1" );
+    Check( "answer cached within its TTL",
+           Resolve( base, cache, "a.test" ).address == "192.0.2.1" && resolver.Queries() == 1 );
+
+    auto missing = Resolve( base, cache, "missing.test" );
+    auto queries = resolver.Queries();
+    Check( "NXDOMAIN fails the lookup", missing.address.empty() && !missing.error.empty() );
+    Check( "failure cached", !Resolve( base, cache, "missing.test" ).error.empty() && resolver.Queries() == queries );
+
+    // the TTL of the answer and max_ttl_s of the hosts file are both 1 s
+    resolver.Set( "a.test", "192.0.2.2", 1 );
+    WriteHostsFile( path, "10.0.0.9 pinned.test\n" );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1100 ) );
+    Check( "queried again once the TTL passed",
+           Resolve( base, cache, "a.test" ).address == "192.0.2.2" && resolver.Queries() == queries + 1 );
+    Check( "changed hosts file read again", Resolve( base, cache, "pinned.test" ).address == "10.0.0.9" );
+    Check( "line removed from hosts file", !Resolve( base, cache, "other.test" ).error.empty() );
+    Check( "pinned host kept", Resolve( base, cache, "fixed.test" ).address == "10.0.0.7" );
+
+    unlink( path );
+    return failures == 0;
+}
+
+void MeasureCached( event_base *base, size_t iterations ) {
+    DnsOptions options;
+    options.hosts_file = "";
+    DnsCache cache( base, options );
+    cache.Seed( "cached.test", "192.0.2.1", 0 );
+    size_t sink          = 0;
+    auto   allocs_before = AllocCounter::Count();
+    auto   start         = Clock::now();
+    for ( size_t i = 0; i < iterations; ++i ) {
+        cache.Resolve( "cached.test", [&sink]( const std::string &address, const std::string & ) {
+            sink += address.size();
+        } );
+    }
+    double elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+    auto   allocs  = AllocCounter::Count() - allocs_before;
+    std::printf( "%-28s %8.1f ns/lookup  %6.2f allocs/lookup  (%zu)\n", "DnsCache::Resolve, cached",
+                 elapsed * 1e9 / iterations, static_cast<double>( allocs ) / iterations, sink % 10 );
+}
+
+void Usage( const char *name ) {
+    std::printf( "usage: %s [options]\n"
+                 "  --iterations=N    cached lookups measured (default 1000000)\n",
+                 name );
+}
+
+bool ParseArgs( int argc, char **argv, DnsBenchOptions &options ) {
+    for ( int i = 1; i < argc; ++i ) {
+        std::string arg   = argv[i];
+        auto        eq    = arg.find( '=' );
+        std::string key   = arg.substr( 0, eq );
+        const char *value = eq == std::string::npos ? "" : argv[i] + eq + 1;
+        if ( key == "--iterations" ) {
+            options.iterations = std::max<size_t>( std::strtoull( value, nullptr, 10 ), 1 );
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main( int argc, char **argv ) {
+    DnsBenchOptions options;
+    if ( !ParseArgs( argc, argv, options ) ) {
+        Usage( argv[0] );
+        return 1;
+    }
+    auto *base = event_base_new();
+    std::printf( "checks against a stand-in resolver and a temporary hosts file\n" );
+    bool passed = CheckCache( base );
+    MeasureCached( base, options.iterations );
+    event_base_free( base );
+    return passed ? 0 : 2;
+}
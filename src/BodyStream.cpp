@@ -0,0 +1,101 @@
+#include "BodyStream.h"
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <memory>
+#include <stdexcept>
+#include "EventLoop.h"
+
+BodyStream::BodyStream( size_t max_buffered ) : max_buffered_( max_buffered ) {
+    if ( max_buffered_ == 0 ) {
+        throw std::invalid_argument( "max_buffered must not be 0" );
+    }
+    pending_ = evbuffer_new();
+    if ( pending_ == nullptr ) {
+        throw std::runtime_error( "Failed to create evbuffer" );
+    }
+}
+
+BodyStream::~BodyStream() {
+    evbuffer_free( pending_ );
+}
+
+bool BodyStream::Read( std::string &chunk ) {
+    std::unique_ptr<evbuffer, decltype( &evbuffer_free )> data( evbuffer_new(), evbuffer_free );
+    if ( !data ) {
+        throw std::runtime_error( "Failed to create evbuffer" );
+    }
+    EventLoop *resume_loop = nullptr;
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+        cond_.wait( lock, [this]() { return evbuffer_get_length( pending_ ) > 0 || closed_; } );
+        if ( evbuffer_get_length( pending_ ) == 0 ) {
+            return false;
+        }
+        // the chains change hands, the data is copied outside the lock
+        evbuffer_add_buffer( data.get(), pending_ );
+        if ( paused_ ) {
+            paused_     = false;
+            resume_loop = loop_;
+        }
+    }
+    if ( resume_loop != nullptr ) {
+        resume_loop->RunInLoop( [self = shared_from_this()]() { self->ResumeReading(); } );
+    }
+    chunk.clear();
+    chunk.reserve( evbuffer_get_length( data.get() ) );
+    while ( size_t length = evbuffer_get_contiguous_space( data.get() ) ) {
+        chunk.append( reinterpret_cast<const char *>( evbuffer_pullup( data.get(), length ) ), length );
+        evbuffer_drain( data.get(), length );
+    }
+    return true;
+}
+
+size_t BodyStream::BufferedSize() const {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return evbuffer_get_length( pending_ );
+}
+
+void BodyStream::Push( EventLoop *loop, evhttp_connection *connection, evbuffer *buffer ) {
+    if ( evbuffer_get_length( buffer ) == 0 ) {
+        return;
+    }
+    connection_ = connection;
+    bool pause  = false;
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        loop_ = loop;
+        // moves the chains evhttp read into, nothing is copied on the loop thread
+        evbuffer_add_buffer( pending_, buffer );
+        if ( !paused_ && evbuffer_get_length( pending_ ) > max_buffered_ ) {
+            paused_ = pause = true;
+        }
+    }
+    cond_.notify_one();
+    if ( pause && connection_ != nullptr ) {
+        // data already read is still delivered, the socket is not read again until the consumer catches up
+        bufferevent_disable( evhttp_connection_get_bufferevent( connection_ ), EV_READ );
+        reading_paused_ = true;
+    }
+}
+
+void BodyStream::Close() {
+    connection_ = nullptr;
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        closed_ = true;
+        loop_   = nullptr;
+    }
+    cond_.notify_all();
+}
+
+void BodyStream::ResumeReading() {
+    if ( reading_paused_ ) {
+        reading_paused_ = false;
+        resumed_        = std::chrono::steady_clock::now();
+    }
+    if ( connection_ != nullptr ) {
+        bufferevent_enable( evhttp_connection_get_bufferevent( connection_ ), EV_READ );
+    }
+}
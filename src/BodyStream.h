@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct evbuffer;
+struct evhttp_connection;
+class EventLoop;
+
+/**
+ * @brief Bounded queue of response body data, set with HttpRequest::SetBodyStream()
+ * The event loop moves each chunk into the queue as it is read from the connection, without copying it, instead of
+ * collecting the whole body in HttpResponse::Body(). Once more than max_buffered bytes are waiting, reading from the
+ * connection is paused until the consumer has taken them. The idle read deadline does not run while reading is paused.
+ */
+class BodyStream final : public std::enable_shared_from_this<BodyStream> {
+public:
+    using Ptr = std::shared_ptr<BodyStream>;
+
+    explicit BodyStream( size_t max_buffered = 1024 * 1024 );
+    BodyStream( const BodyStream & )            = delete;
+    BodyStream &operator=( const BodyStream & ) = delete;
+    ~BodyStream();
+
+    /**
+     * @brief Wait for body data, must not be called on the event loop thread
+     * Takes all data that has arrived since the last call, copied into chunk once.
+     *
+     * @param chunk
+     * @return bool false once the response is done and all data has been read, see HttpResponse for the result
+     */
+    bool Read( std::string &chunk );
+
+    size_t BufferedSize() const;
+
+private:
+    friend void OnRequestChunk( struct evhttp_request *, void * );
+    friend class HttpResponse;
+    friend class HttpClient;
+
+    // loop thread only
+    void Push( EventLoop *loop, evhttp_connection *connection, evbuffer *buffer );
+    void Close();
+    void ResumeReading();
+
+    const size_t max_buffered_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cond_;
+    evbuffer               *pending_ = nullptr;  // holds the chains read from the connection, only under mutex_
+    bool                    paused_  = false;
+    bool                    closed_  = false;
+    EventLoop              *loop_    = nullptr;
+
+    // loop thread only
+    evhttp_connection                    *connection_     = nullptr;  // null once closed
+    bool                                  reading_paused_ = false;
+    std::chrono::steady_clock::time_point resumed_;  // reading was last resumed
+};
@@ -0,0 +1,204 @@
+#include "ConnectionPool.h"
+#include <event2/bufferevent.h>
+#ifdef BUILD_WITH_SSL
+    #include <event2/bufferevent_ssl.h>
+    #include <openssl/ssl.h>
+#endif
+#include <event2/event.h>
+#include <event2/http.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+void FreeConnection( evhttp_connection *connection ) {
+#ifdef BUILD_WITH_SSL
+    // freeing an SSL that has not sent close_notify marks its session as not resumable
+    auto *ssl = bufferevent_openssl_get_ssl( evhttp_connection_get_bufferevent( connection ) );
+    if ( ssl != nullptr && SSL_is_init_finished( ssl ) ) {
+        SSL_shutdown( ssl );
+    }
+#endif
+    evhttp_connection_free( connection );
+}
+
+}  // namespace
+
+ConnectionPool::ConnectionPool( event_base *base, const ConnectionPoolOptions &options )
+    : base_( base ), options_( options ) {
+    if ( options_.max_per_host == 0 ) {
+        options_.max_per_host = 1;
+    }
+    if ( options_.idle_timeout_ms > 0 ) {
+        idle_timer_ = event_new( base_, -1, EV_PERSIST, OnIdleTimer, this );
+        if ( idle_timer_ == nullptr ) {
+            throw std::runtime_error( "Failed to create idle timer" );
+        }
+        int     interval_ms = std::max( options_.idle_timeout_ms / 2, 100 );
+        timeval interval{ interval_ms / 1000, ( interval_ms % 1000 ) * 1000 };
+        event_add( idle_timer_, &interval );
+    }
+}
+
+ConnectionPool::~ConnectionPool() {
+    if ( idle_timer_ ) {
+        event_free( idle_timer_ );
+        idle_timer_ = nullptr;
+    }
+    std::lock_guard<std::mutex> lock( mutex_ );
+    for ( auto &[key, entries] : hosts_ ) {
+        for ( auto &entry : entries ) {
+            evhttp_connection_set_closecb( entry->connection, nullptr, nullptr );
+            FreeConnection( entry->connection );
+        }
+    }
+    hosts_.clear();
+    entries_.clear();
+}
+
+std::string ConnectionPool::MakeKey( const std::string &scheme, const std::string &host, uint16_t port ) {
+    return ( scheme.empty() ? "http" : scheme ) + "://" + host + ":" + std::to_string( port );
+}
+
+evhttp_connection *ConnectionPool::Acquire( const std::string &key ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto                        host_it = hosts_.find( key );
+    if ( host_it == hosts_.end() ) {
+        return nullptr;
+    }
+    auto  &entries = host_it->second;
+    Entry *least   = nullptr;
+    for ( auto &entry : entries ) {
+        if ( entry->closed ) {
+            continue;
+        }
+        if ( entry->in_flight == 0 ) {
+            --idle_count_;
+            ++entry->in_flight;
+            return entry->connection;
+        }
+        if ( least == nullptr || entry->in_flight < least->in_flight ) {
+            least = entry.get();
+        }
+    }
+    if ( least != nullptr && entries.size() >= options_.max_per_host ) {
+        // host is at its limit, evhttp_connection queues the request until the current one finishes
+        ++least->in_flight;
+        return least->connection;
+    }
+    return nullptr;
+}
+
+void ConnectionPool::Add( const std::string &key, evhttp_connection *connection ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    evhttp_connection_set_closecb( connection, OnConnectionClose, this );
+    auto entry        = std::make_unique<Entry>();
+    entry->key        = key;
+    entry->connection = connection;
+    entry->in_flight  = 1;
+    entries_[connection] = entry.get();
+    hosts_[key].push_back( std::move( entry ) );
+}
+
+void ConnectionPool::Release( evhttp_connection *connection, bool reusable ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto                        it = entries_.find( connection );
+    if ( it == entries_.end() ) {
+        return;
+    }
+    Entry *entry = it->second;
+    if ( entry->in_flight > 0 ) {
+        --entry->in_flight;
+    }
+    if ( !reusable ) {
+        entry->closed = true;
+    }
+    if ( entry->in_flight > 0 ) {
+        return;
+    }
+    if ( entry->closed ) {
+        Remove( entry );
+        return;
+    }
+    entry->last_used = Clock::now();
+    ++idle_count_;
+    if ( idle_count_ > options_.max_idle ) {
+        EvictIdle( entry->last_used );
+    }
+}
+
+size_t ConnectionPool::IdleCount() const {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return idle_count_;
+}
+
+void ConnectionPool::OnConnectionClose( evhttp_connection *connection, void *arg ) {
+    auto                       *pool = reinterpret_cast<ConnectionPool *>( arg );
+    std::lock_guard<std::mutex> lock( pool->mutex_ );
+    auto                        it = pool->entries_.find( connection );
+    if ( it == pool->entries_.end() ) {
+        return;
+    }
+    // a closed connection would have to reconnect (and redo the TLS handshake) anyway, drop it from the pool
+    Entry *entry  = it->second;
+    entry->closed = true;
+    if ( entry->in_flight == 0 ) {
+        --pool->idle_count_;
+        pool->Remove( entry );
+    }
+}
+
+void ConnectionPool::OnIdleTimer( int, short, void *arg ) {
+    auto                       *pool = reinterpret_cast<ConnectionPool *>( arg );
+    std::lock_guard<std::mutex> lock( pool->mutex_ );
+    pool->EvictIdle( Clock::now() );
+}
+
+void ConnectionPool::Remove( Entry *entry ) {
+    auto *connection = entry->connection;
+    entries_.erase( connection );
+    auto host_it = hosts_.find( entry->key );
+    if ( host_it != hosts_.end() ) {
+        auto &entries = host_it->second;
+        entries.erase( std::remove_if( entries.begin(), entries.end(),
+                                       [entry]( const EntryPtr &item ) { return item.get() == entry; } ),
+                       entries.end() );
+        if ( entries.empty() ) {
+            hosts_.erase( host_it );
+        }
+    }
+    FreeDeferred( connection );
+}
+
+void ConnectionPool::EvictIdle( Clock::time_point now ) {
+    std::vector<Entry *> idle;
+    for ( auto &[key, entries] : hosts_ ) {
+        for ( auto &entry : entries ) {
+            if ( !entry->closed && entry->in_flight == 0 ) {
+                idle.push_back( entry.get() );
+            }
+        }
+    }
+    // oldest first
+    std::sort( idle.begin(), idle.end(),
+               []( const Entry *lhs, const Entry *rhs ) { return lhs->last_used < rhs->last_used; } );
+    auto timeout = std::chrono::milliseconds( options_.idle_timeout_ms );
+    for ( auto *entry : idle ) {
+        bool expired = options_.idle_timeout_ms > 0 && now - entry->last_used >= timeout;
+        if ( !expired && idle_count_ <= options_.max_idle ) {
+            break;
+        }
+        --idle_count_;
+        Remove( entry );
+    }
+}
+
+void ConnectionPool::FreeDeferred( evhttp_connection *connection ) {
+    // may be called from inside an evhttp callback of this connection, so free it on the next loop iteration
+    evhttp_connection_set_closecb( connection, nullptr, nullptr );
+    timeval zero{ 0, 0 };
+    event_base_once(
+        base_, -1, EV_TIMEOUT,
+        []( int, short, void *arg ) { FreeConnection( reinterpret_cast<evhttp_connection *>( arg ) ); },
+        connection, &zero );
+}
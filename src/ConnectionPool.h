@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct evhttp_connection;
+struct event_base;
+struct event;
+
+struct ConnectionPoolOptions {
+    size_t max_idle        = 64;     // idle connections kept across all hosts
+    size_t max_per_host    = 8;      // connections opened per (scheme, host, port)
+    int    idle_timeout_ms = 60000;  // idle connections older than this are closed
+};
+
+/**
+ * @brief Keep-alive evhttp_connection pool keyed by (scheme, host, port)
+ * Connections are opened by the caller when Acquire() has none to offer, registered with Add() and handed back with
+ * Release() when the request on them has finished. Idle connections are reused before new ones are opened. Once a
+ * host reaches max_per_host, further requests are queued on the least busy connection of that host.
+ */
+class ConnectionPool final {
+public:
+    ConnectionPool( event_base *base, const ConnectionPoolOptions &options );
+    ConnectionPool( const ConnectionPool & )            = delete;
+    ConnectionPool &operator=( const ConnectionPool & ) = delete;
+    ~ConnectionPool();
+
+    static std::string MakeKey( const std::string &scheme, const std::string &host, uint16_t port );
+
+    /**
+     * @brief Get an idle connection for key, or the least busy one if key is at max_per_host
+     *
+     * @param key from MakeKey()
+     * @return evhttp_connection* nullptr if the caller should open a new connection and Add() it
+     */
+    evhttp_connection *Acquire( const std::string &key );
+
+    /**
+     * @brief Take ownership of a newly opened connection, it counts as acquired
+     *
+     * @param key from MakeKey()
+     * @param connection
+     */
+    void Add( const std::string &key, evhttp_connection *connection );
+
+    /**
+     * @brief Hand back a connection returned by Acquire() or given to Add()
+     *
+     * @param connection
+     * @param reusable false if the request failed, the connection is closed once it has no pending request
+     */
+    void Release( evhttp_connection *connection, bool reusable );
+
+    size_t IdleCount() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string        key;
+        evhttp_connection *connection = nullptr;
+        size_t             in_flight  = 0;
+        bool               closed     = false;
+        Clock::time_point  last_used;
+    };
+    using EntryPtr = std::unique_ptr<Entry>;
+
+    static void OnConnectionClose( evhttp_connection *connection, void *arg );
+    static void OnIdleTimer( int, short, void *arg );
+
+    void Remove( Entry *entry );
+    void EvictIdle( Clock::time_point now );
+    void FreeDeferred( evhttp_connection *connection );
+
+    event_base           *base_ = nullptr;
+    ConnectionPoolOptions options_;
+    event                *idle_timer_ = nullptr;
+
+    mutable std::mutex                                      mutex_;
+    std::unordered_map<std::string, std::vector<EntryPtr>>  hosts_;
+    std::unordered_map<evhttp_connection *, Entry *>        entries_;
+    size_t                                                  idle_count_ = 0;
+};
@@ -0,0 +1,499 @@
+#include "DiskCache.h"
+#ifndef _WIN32
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #include <algorithm>
+    #include <cerrno>
+    #include <chrono>
+    #include <cinttypes>
+    #include <cstdio>
+    #include <cstring>
+    #include <iterator>
+    #include <stdexcept>
+    #include <unordered_set>
+    #include <utility>
+
+    #include "ResponseCache.h"
+
+namespace {
+
+constexpr char     kMagic[4]     = { 'H', 'C', 'D', 'C' };
+constexpr uint32_t kVersion      = 1;
+constexpr size_t   kHeaderBytes  = sizeof( kMagic ) + sizeof( kVersion );
+constexpr uint8_t  kPut          = 1;
+constexpr uint8_t  kErase        = 2;
+constexpr size_t   kMaxRecord    = 1 << 24;  // anything larger is a torn or corrupt record
+constexpr size_t   kCompactSlack = 1 << 20;  // superseded records kept before the index is rewritten
+
+// index records are little endian on every platform this builds on, fields are written in host order
+class RecordWriter {
+public:
+    template <typename T>
+    void Put( T value ) {
+        data_.append( reinterpret_cast<const char *>( &value ), sizeof( value ) );
+    }
+    void Put( std::string_view value ) {
+        Put( static_cast<uint32_t>( value.size() ) );
+        data_.append( value );
+    }
+    // prefixed with its length
+    std::string Finish() {
+        std::string record;
+        auto        length = static_cast<uint32_t>( data_.size() );
+        record.append( reinterpret_cast<const char *>( &length ), sizeof( length ) );
+        return record + data_;
+    }
+
+private:
+    std::string data_;
+};
+
+class RecordReader {
+public:
+    explicit RecordReader( std::string_view data ) : data_( data ) {}
+
+    template <typename T>
+    bool Get( T &value ) {
+        if ( data_.size() < sizeof( value ) ) {
+            return false;
+        }
+        memcpy( &value, data_.data(), sizeof( value ) );
+        data_.remove_prefix( sizeof( value ) );
+        return true;
+    }
+    bool Get( std::string &value ) {
+        uint32_t size = 0;
+        if ( !Get( size ) || data_.size() < size ) {
+            return false;
+        }
+        value.assign( data_.data(), size );
+        data_.remove_prefix( size );
+        return true;
+    }
+
+private:
+    std::string_view data_;
+};
+
+int64_t WallMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>( system_clock::now().time_since_epoch() ).count();
+}
+
+bool WriteAll( int fd, const char *data, size_t size ) {
+    while ( size > 0 ) {
+        auto n = write( fd, data, size );
+        if ( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if ( n <= 0 ) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>( n );
+    }
+    return true;
+}
+
+bool ReadAll( const std::string &path, std::string &data ) {
+    int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) {
+        return errno == ENOENT;
+    }
+    char buf[65536];
+    for ( ;; ) {
+        auto n = read( fd, buf, sizeof( buf ) );
+        if ( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if ( n <= 0 ) {
+            close( fd );
+            return n == 0;
+        }
+        data.append( buf, static_cast<size_t>( n ) );
+    }
+}
+
+std::string PutRecord( const std::string &key, uint64_t file, size_t size, const CachedResponse &entry ) {
+    // freshness is kept as wall clock time, the steady clock does not survive a restart
+    auto now  = CachedResponse::Clock::now();
+    auto wall = WallMs();
+    auto ms   = []( CachedResponse::Clock::duration d ) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>( d ).count();
+    };
+    RecordWriter writer;
+    writer.Put( kPut );
+    writer.Put( std::string_view( key ) );
+    writer.Put( file );
+    writer.Put( static_cast<uint64_t>( size ) );
+    writer.Put( static_cast<int32_t>( entry.status_code ) );
+    writer.Put( std::string_view( entry.http_version ) );
+    writer.Put( std::string_view( entry.status_phrase ) );
+    writer.Put( static_cast<uint32_t>( entry.header.Size() ) );
+    for ( auto &field : entry.header ) {
+        writer.Put( std::string_view( field.name ) );
+        writer.Put( std::string_view( field.value ) );
+    }
+    writer.Put( static_cast<uint32_t>( entry.vary.size() ) );
+    for ( auto &field : entry.vary ) {
+        writer.Put( std::string_view( field.name ) );
+        writer.Put( std::string_view( field.value ) );
+    }
+    writer.Put( static_cast<int64_t>( wall - ms( now - entry.stored ) ) );
+    writer.Put( static_cast<int64_t>( wall + ms( entry.expires - now ) ) );
+    writer.Put( entry.initial_age );
+    return writer.Finish();
+}
+
+std::string EraseRecord( const std::string &key ) {
+    RecordWriter writer;
+    writer.Put( kErase );
+    writer.Put( std::string_view( key ) );
+    return writer.Finish();
+}
+
+// the entry of a put record, without body
+bool ParsePut( RecordReader &reader, std::string &key, uint64_t &file, uint64_t &size, CachedResponse &entry ) {
+    int32_t  status = 0;
+    uint32_t count  = 0;
+    int64_t  stored = 0, expires = 0;
+    if ( !reader.Get( key ) || !reader.Get( file ) || !reader.Get( size ) || !reader.Get( status ) ||
+         !reader.Get( entry.http_version ) || !reader.Get( entry.status_phrase ) || !reader.Get( count ) ) {
+        return false;
+    }
+    for ( uint32_t i = 0; i < count; ++i ) {
+        std::string name, value;
+        if ( !reader.Get( name ) || !reader.Get( value ) ) {
+            return false;
+        }
+        entry.header.Add( std::move( name ), std::move( value ) );
+    }
+    if ( !reader.Get( count ) ) {
+        return false;
+    }
+    for ( uint32_t i = 0; i < count; ++i ) {
+        HttpHeaders::Field field;
+        if ( !reader.Get( field.name ) || !reader.Get( field.value ) ) {
+            return false;
+        }
+        entry.vary.push_back( std::move( field ) );
+    }
+    if ( !reader.Get( stored ) || !reader.Get( expires ) || !reader.Get( entry.initial_age ) ) {
+        return false;
+    }
+    auto now          = CachedResponse::Clock::now();
+    auto wall         = WallMs();
+    entry.status_code = status;
+    entry.stored      = now - std::chrono::milliseconds( std::max<int64_t>( wall - stored, 0 ) );
+    entry.expires     = now + std::chrono::milliseconds( expires - wall );
+    return true;
+}
+
+}  // namespace
+
+std::shared_ptr<const MappedFile> MappedFile::Open( const std::string &path, size_t size ) {
+    int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) {
+        return nullptr;
+    }
+    struct stat st;
+    void       *data = MAP_FAILED;
+    if ( fstat( fd, &st ) == 0 && static_cast<size_t>( st.st_size ) == size && size > 0 ) {
+        data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    // the mapping keeps the file, even once it is unlinked
+    close( fd );
+    if ( data == MAP_FAILED ) {
+        return nullptr;
+    }
+    return std::shared_ptr<const MappedFile>( new MappedFile( data, size ) );
+}
+
+MappedFile::MappedFile( void *data, size_t size ) : data_( data ), size_( size ) {}
+
+MappedFile::~MappedFile() {
+    munmap( data_, size_ );
+}
+
+std::string_view MappedFile::Data() const {
+    return std::string_view( static_cast<const char *>( data_ ), size_ );
+}
+
+DiskCache::DiskCache( const std::string &dir, size_t max_bytes ) : dir_( dir ), max_bytes_( max_bytes ) {
+    if ( mkdir( dir_.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+        throw std::runtime_error( "Failed to create cache directory " + dir_ + ": " + strerror( errno ) );
+    }
+    Load();
+    writer_ = std::thread( [this]() { Run(); } );
+}
+
+DiskCache::~DiskCache() {
+    {
+        std::lock_guard<std::mutex> lock( tasks_mutex_ );
+        stopping_ = true;
+    }
+    tasks_cv_.notify_one();
+    writer_.join();
+    close( index_fd_ );
+}
+
+std::shared_ptr<const CachedResponse> DiskCache::Find( const std::string &key, const HttpHeaders &request_header ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto                        it = index_.find( key );
+    if ( it == index_.end() ) {
+        return nullptr;
+    }
+    auto &node = *it->second;
+    for ( auto &field : node.entry->vary ) {
+        if ( request_header.Get( field.name ) != field.value ) {
+            return nullptr;
+        }
+    }
+    if ( !node.entry->mapped ) {
+        // mapped once, the mapping lives as long as the entry
+        auto mapped = MappedFile::Open( FilePath( node.file ), node.size );
+        if ( !mapped ) {
+            // removed or truncated behind our back
+            Erase( key );
+            return nullptr;
+        }
+        auto entry    = std::make_shared<CachedResponse>( *node.entry );
+        entry->mapped = std::move( mapped );
+        node.entry    = std::move( entry );
+    }
+    lru_.splice( lru_.begin(), lru_, it->second );
+    return node.entry;
+}
+
+void DiskCache::Store( const std::string &key, std::shared_ptr<const CachedResponse> entry ) {
+    if ( entry->mapped ) {
+        // revalidated, only the record changes
+        std::lock_guard<std::mutex> lock( mutex_ );
+        auto                        it = index_.find( key );
+        if ( it == index_.end() || it->second->entry->mapped != entry->mapped ) {
+            return;
+        }
+        auto &node = *it->second;
+        records_ -= node.record.size();
+        node.entry  = entry;
+        node.record = PutRecord( key, node.file, node.size, *entry );
+        records_ += node.record.size();
+        Post( [this, record = node.record]() { Append( record ); } );
+        return;
+    }
+    if ( !entry->body || entry->body->size() > max_bytes_ ) {
+        Erase( key );
+        return;
+    }
+    Post( [this, key, entry = std::move( entry )]() { Write( key, entry ); } );
+}
+
+void DiskCache::Erase( const std::string &key ) {
+    // looked up on the writer thread, behind the writes of key still queued
+    Post( [this, key]() {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        auto                        it = index_.find( key );
+        if ( it != index_.end() ) {
+            Append( EraseRecord( key ) );
+            Remove( it->second, true );
+        }
+    } );
+}
+
+size_t DiskCache::Bytes() const {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return bytes_;
+}
+
+size_t DiskCache::MaxBytes() const {
+    return max_bytes_;
+}
+
+void DiskCache::Load() {
+    auto        path = dir_ + "/index";
+    std::string data;
+    if ( !ReadAll( path, data ) ) {
+        throw std::runtime_error( "Failed to read cache index " + path + ": " + strerror( errno ) );
+    }
+    // an index of another version is dropped with all its files
+    size_t offset = kHeaderBytes;
+    if ( data.size() < kHeaderBytes || memcmp( data.data(), kMagic, sizeof( kMagic ) ) != 0 ||
+         memcmp( data.data() + sizeof( kMagic ), &kVersion, sizeof( kVersion ) ) != 0 ) {
+        offset = data.size();
+    }
+    // replayed up to the first torn record, left by a crash in the middle of an append
+    while ( data.size() - offset >= sizeof( uint32_t ) ) {
+        uint32_t length = 0;
+        memcpy( &length, data.data() + offset, sizeof( length ) );
+        if ( length == 0 || length > kMaxRecord || data.size() - offset - sizeof( length ) < length ) {
+            break;
+        }
+        std::string_view record( data.data() + offset, sizeof( length ) + length );
+        RecordReader     reader( record.substr( sizeof( length ) ) );
+        offset += record.size();
+        uint8_t     op = 0;
+        std::string key;
+        if ( !reader.Get( op ) ) {
+            break;
+        }
+        if ( op == kErase && reader.Get( key ) ) {
+            auto it = index_.find( key );
+            if ( it != index_.end() ) {
+                Remove( it->second, false );
+            }
+            continue;
+        }
+        auto     entry = std::make_shared<CachedResponse>();
+        uint64_t file = 0, size = 0;
+        if ( op != kPut || !ParsePut( reader, key, file, size, *entry ) ) {
+            break;
+        }
+        next_file_ = std::max( next_file_, file + 1 );
+        Insert( Node{ key, file, static_cast<size_t>( size ), std::string( record ), std::move( entry ) } );
+    }
+    // body files no entry refers to are left from replaced entries, or from writes cut short
+    std::unordered_set<uint64_t> live;
+    for ( auto &node : lru_ ) {
+        live.insert( node.file );
+    }
+    if ( auto *dir = opendir( dir_.c_str() ) ) {
+        while ( auto *ent = readdir( dir ) ) {
+            uint64_t file = 0;
+            char     suffix[8] = {};
+            if ( sscanf( ent->d_name, "%" SCNx64 ".%7s", &file, suffix ) == 2 &&
+                 ( strcmp( suffix, "body" ) == 0 || strcmp( suffix, "tmp" ) == 0 ) ) {
+                next_file_ = std::max( next_file_, file + 1 );
+                if ( strcmp( suffix, "tmp" ) == 0 || live.count( file ) == 0 ) {
+                    unlink( ( dir_ + "/" + ent->d_name ).c_str() );
+                }
+            }
+        }
+        closedir( dir );
+    }
+    while ( bytes_ > max_bytes_ ) {
+        Remove( std::prev( lru_.end() ), true );
+    }
+    Compact();
+    if ( index_fd_ < 0 ) {
+        throw std::runtime_error( "Failed to write cache index " + path + ": " + strerror( errno ) );
+    }
+}
+
+void DiskCache::Run() {
+    for ( ;; ) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock( tasks_mutex_ );
+            tasks_cv_.wait( lock, [this]() { return stopping_ || !tasks_.empty(); } );
+            if ( tasks_.empty() ) {
+                return;
+            }
+            task = std::move( tasks_.front() );
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+void DiskCache::Post( std::function<void()> task ) {
+    {
+        std::lock_guard<std::mutex> lock( tasks_mutex_ );
+        tasks_.push_back( std::move( task ) );
+    }
+    tasks_cv_.notify_one();
+}
+
+void DiskCache::Write( const std::string &key, std::shared_ptr<const CachedResponse> entry ) {
+    // renamed into place once complete, so a crash leaves at most a .tmp file behind
+    auto file = next_file_++;
+    auto path = FilePath( file );
+    auto tmp  = path.substr( 0, path.size() - 4 ) + "tmp";
+    int  fd   = open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 ) {
+        return;
+    }
+    bool written = WriteAll( fd, entry->body->data(), entry->body->size() );
+    if ( close( fd ) != 0 || !written || rename( tmp.c_str(), path.c_str() ) != 0 ) {
+        unlink( tmp.c_str() );
+        return;
+    }
+    auto stored  = std::make_shared<CachedResponse>( *entry );
+    stored->body = nullptr;
+    auto record  = PutRecord( key, file, entry->body->size(), *stored );
+    Append( record );
+    std::lock_guard<std::mutex> lock( mutex_ );
+    Insert( Node{ key, file, entry->body->size(), std::move( record ), std::move( stored ) } );
+    while ( bytes_ > max_bytes_ ) {
+        auto &oldest = lru_.back();
+        Append( EraseRecord( oldest.key ) );
+        Remove( std::prev( lru_.end() ), true );
+    }
+    if ( index_bytes_ > kHeaderBytes + records_ + kCompactSlack && index_bytes_ > 2 * ( kHeaderBytes + records_ ) ) {
+        Compact();
+    }
+}
+
+void DiskCache::Append( const std::string &record ) {
+    if ( index_fd_ >= 0 && WriteAll( index_fd_, record.data(), record.size() ) ) {
+        index_bytes_ += record.size();
+    }
+}
+
+void DiskCache::Compact() {
+    // the live records in a new file, replacing the index in one rename
+    auto path = dir_ + "/index";
+    auto tmp  = path + ".tmp";
+    int  fd   = open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 ) {
+        return;
+    }
+    std::string data( kMagic, sizeof( kMagic ) );
+    data.append( reinterpret_cast<const char *>( &kVersion ), sizeof( kVersion ) );
+    // least recently used first, so a restart keeps the order
+    for ( auto it = lru_.rbegin(); it != lru_.rend(); ++it ) {
+        data += it->record;
+    }
+    bool written = WriteAll( fd, data.data(), data.size() );
+    if ( close( fd ) != 0 || !written || rename( tmp.c_str(), path.c_str() ) != 0 ) {
+        unlink( tmp.c_str() );
+        return;
+    }
+    if ( index_fd_ >= 0 ) {
+        close( index_fd_ );
+    }
+    index_fd_    = open( path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC );
+    index_bytes_ = data.size();
+}
+
+void DiskCache::Insert( Node node ) {
+    auto it = index_.find( node.key );
+    if ( it != index_.end() ) {
+        // a replaced body file is only removed when it is not the one of node
+        Remove( it->second, it->second->file != node.file );
+    }
+    bytes_ += node.size;
+    records_ += node.record.size();
+    lru_.push_front( std::move( node ) );
+    index_.emplace( lru_.front().key, lru_.begin() );
+}
+
+void DiskCache::Remove( std::list<Node>::iterator it, bool unlink_file ) {
+    if ( unlink_file ) {
+        // a mapping handed out keeps the data until it is released
+        unlink( FilePath( it->file ).c_str() );
+    }
+    bytes_ -= it->size;
+    records_ -= it->record.size();
+    index_.erase( it->key );
+    lru_.erase( it );
+}
+
+std::string DiskCache::FilePath( uint64_t file ) const {
+    char name[32];
+    snprintf( name, sizeof( name ), "/%016" PRIx64 ".body", file );
+    return dir_ + name;
+}
+#endif
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "HttpHeaders.h"
+
+struct CachedResponse;
+
+/**
+ * @brief Read-only mapping of a whole file, unmapped when the last reference goes
+ */
+class MappedFile final {
+public:
+    // nullptr if the file can not be opened or does not have size bytes
+    static std::shared_ptr<const MappedFile> Open( const std::string &path, size_t size );
+
+    MappedFile( const MappedFile & )            = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+    ~MappedFile();
+
+    std::string_view Data() const;
+
+private:
+    MappedFile( void *data, size_t size );
+
+    void  *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * @brief On-disk tier of ResponseCache for large bodies, kept across restarts
+ * Each body is a file of its own in the directory, served through a read-only mapping without copying it. Status,
+ * fields and freshness of all entries are in an append-only index of binary records, replayed on open and rewritten
+ * when mostly superseded. Files and the index are written by a thread of this cache, so storing never waits for the
+ * disk; an entry can be found once written. Entries are evicted least recently used first when the bodies exceed
+ * max_bytes, after a restart in the order they were stored.
+ * Not available on Windows.
+ */
+class DiskCache final {
+public:
+    /**
+     * @brief Open or create the cache in dir
+     * Throws std::runtime_error if dir can not be created or its index can not be opened.
+     *
+     * @param dir
+     * @param max_bytes of all bodies
+     */
+    DiskCache( const std::string &dir, size_t max_bytes );
+    DiskCache( const DiskCache & )            = delete;
+    DiskCache &operator=( const DiskCache & ) = delete;
+    // waits for the pending writes
+    ~DiskCache();
+
+    // entry for key whose Vary fields match request_header, with CachedResponse::mapped set, nullptr if none
+    std::shared_ptr<const CachedResponse> Find( const std::string &key, const HttpHeaders &request_header );
+    // entry has its body in CachedResponse::body, or is a revalidated entry of this cache still mapping its file
+    void   Store( const std::string &key, std::shared_ptr<const CachedResponse> entry );
+    // done in order with the stores of key still being written
+    void   Erase( const std::string &key );
+    size_t Bytes() const;
+    size_t MaxBytes() const;
+
+private:
+    struct Node {
+        std::string                           key;
+        uint64_t                              file = 0;  // body file number
+        size_t                                size = 0;
+        std::string                           record;  // last index record of the entry, for rewriting the index
+        std::shared_ptr<const CachedResponse> entry;   // without body, mapped on first Find()
+    };
+
+    void        Load();
+    void        Run();
+    void        Post( std::function<void()> task );
+    void        Write( const std::string &key, std::shared_ptr<const CachedResponse> entry );
+    void        Append( const std::string &record );
+    void        Compact();
+    void        Insert( Node node );
+    void        Remove( std::list<Node>::iterator it, bool unlink_file );
+    std::string FilePath( uint64_t file ) const;
+
+    const std::string dir_;
+    const size_t      max_bytes_;
+    // index, locked by mutex_
+    mutable std::mutex                                          mutex_;
+    std::list<Node>                                             lru_;  // most recently used first
+    std::unordered_map<std::string, std::list<Node>::iterator> index_;
+    size_t                                                      bytes_   = 0;  // of the bodies
+    size_t                                                      records_ = 0;  // of the live index records
+    // writer thread only
+    int      index_fd_    = -1;
+    size_t   index_bytes_ = 0;  // of the index file, superseded records included
+    uint64_t next_file_   = 1;
+    // tasks for the writer thread
+    std::mutex                        tasks_mutex_;
+    std::condition_variable           tasks_cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool                              stopping_ = false;
+    std::thread                       writer_;
+};
@@ -0,0 +1,240 @@
+#include "DnsCache.h"
+#include <event2/dns.h>
+#include <event2/util.h>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <netinet/in.h>
+#endif
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::string ToLower( std::string value ) {
+    std::transform( value.begin(), value.end(), value.begin(),
+                    []( unsigned char c ) { return static_cast<char>( std::tolower( c ) ); } );
+    return value;
+}
+
+bool IsNumericAddress( const std::string &host ) {
+    unsigned char buf[sizeof( in6_addr )];
+    return evutil_inet_pton( AF_INET, host.c_str(), buf ) == 1 ||
+           evutil_inet_pton( AF_INET6, host.c_str(), buf ) == 1;
+}
+
+}  // namespace
+
+DnsCache::DnsCache( event_base *base, const DnsOptions &options ) : options_( options ) {
+    int flags = EVDNS_BASE_DISABLE_WHEN_INACTIVE;
+    if ( options_.nameservers.empty() ) {
+        flags |= EVDNS_BASE_INITIALIZE_NAMESERVERS;
+    }
+    dns_ = evdns_base_new( base, flags );
+    if ( dns_ == nullptr ) {
+        throw std::runtime_error( "Failed to create evdns base" );
+    }
+    for ( auto &nameserver : options_.nameservers ) {
+        if ( evdns_base_nameserver_ip_add( dns_, nameserver.c_str() ) != 0 ) {
+            evdns_base_free( dns_, 0 );
+            throw std::invalid_argument( "invalid nameserver: " + nameserver );
+        }
+    }
+    LoadHostsFile();
+    for ( auto &[host, address] : options_.hosts ) {
+        Seed( host, address, 0 );
+    }
+}
+
+DnsCache::~DnsCache() {
+    // outstanding queries are dropped without calling back
+    evdns_base_free( dns_, 0 );
+    for ( auto &[host, lookup] : lookups_ ) {
+        delete lookup;
+    }
+}
+
+uint64_t DnsCache::Resolve( const std::string &host, Callback callback ) {
+    if ( IsNumericAddress( host ) ) {
+        callback( host, "" );
+        return 0;
+    }
+    if ( Clock::now() >= hosts_expire_ ) {
+        LoadHostsFile();
+    }
+    auto name = ToLower( host );
+    auto it   = entries_.find( name );
+    if ( it != entries_.end() ) {
+        auto &entry = it->second;
+        if ( entry.pinned || Clock::now() < entry.expire ) {
+            if ( entry.addresses.empty() ) {
+                callback( "", "failed to resolve " + host + " (cached)" );
+            }
+            else {
+                callback( entry.addresses[entry.next++ % entry.addresses.size()], "" );
+            }
+            return 0;
+        }
+        entries_.erase( it );
+    }
+    uint64_t ticket = next_ticket_++;
+    auto     lookup_it = lookups_.find( name );
+    if ( lookup_it != lookups_.end() ) {
+        // a query for this name is already running
+        lookup_it->second->waiters.emplace( ticket, std::move( callback ) );
+        tickets_[ticket] = lookup_it->second;
+        return ticket;
+    }
+    auto *lookup  = new Lookup();
+    lookup->cache = this;
+    lookup->host  = name;
+    if ( !StartQuery( lookup ) ) {
+        delete lookup;
+        callback( "", "failed to start resolving " + host );
+        return 0;
+    }
+    lookup->waiters.emplace( ticket, std::move( callback ) );
+    lookups_[name]   = lookup;
+    tickets_[ticket] = lookup;
+    return ticket;
+}
+
+void DnsCache::Cancel( uint64_t ticket ) {
+    auto it = tickets_.find( ticket );
+    if ( it == tickets_.end() ) {
+        return;
+    }
+    it->second->waiters.erase( ticket );
+    tickets_.erase( it );
+}
+
+void DnsCache::Seed( const std::string &host, const std::string &address, int ttl_s ) {
+    if ( !IsNumericAddress( address ) ) {
+        throw std::invalid_argument( "not a numeric address: " + address );
+    }
+    auto &entry = entries_[ToLower( host )];
+    entry.addresses.assign( 1, address );
+    entry.pinned     = ttl_s <= 0;
+    entry.hosts_file = false;
+    entry.expire     = Clock::now() + std::chrono::seconds( ttl_s );
+    entry.next       = 0;
+}
+
+void DnsCache::OnResolved( int result, char type, int count, int ttl, void *addresses, void *arg ) {
+    auto *lookup = reinterpret_cast<Lookup *>( arg );
+    auto *cache  = lookup->cache;
+    if ( result != DNS_ERR_NONE || count <= 0 ) {
+        // no A record, try AAAA before giving up
+        if ( result != DNS_ERR_SHUTDOWN && result != DNS_ERR_CANCEL && !lookup->ipv6 ) {
+            lookup->ipv6 = true;
+            if ( cache->StartQuery( lookup ) ) {
+                return;
+            }
+        }
+        cache->Finish( lookup, evdns_err_to_string( result ) );
+        return;
+    }
+    Entry entry;
+    char  buf[64];
+    for ( int i = 0; i < count; ++i ) {
+        const char *address = nullptr;
+        if ( type == DNS_IPv4_A ) {
+            address = evutil_inet_ntop( AF_INET, reinterpret_cast<in_addr *>( addresses ) + i, buf, sizeof( buf ) );
+        }
+        else if ( type == DNS_IPv6_AAAA ) {
+            address = evutil_inet_ntop( AF_INET6, reinterpret_cast<in6_addr *>( addresses ) + i, buf, sizeof( buf ) );
+        }
+        if ( address != nullptr ) {
+            entry.addresses.emplace_back( address );
+        }
+    }
+    if ( entry.addresses.empty() ) {
+        cache->Finish( lookup, "no usable address" );
+        return;
+    }
+    auto &options = cache->options_;
+    ttl           = std::clamp( ttl, options.min_ttl_s, std::max( options.min_ttl_s, options.max_ttl_s ) );
+    entry.expire  = Clock::now() + std::chrono::seconds( ttl );
+    cache->entries_[lookup->host] = std::move( entry );
+    cache->Finish( lookup, "" );
+}
+
+void DnsCache::LoadHostsFile() {
+    auto now      = Clock::now();
+    hosts_expire_ = now + std::chrono::seconds( std::max( options_.max_ttl_s, 1 ) );
+    if ( options_.hosts_file.empty() ) {
+        hosts_expire_ = Clock::time_point::max();
+        return;
+    }
+    std::unordered_map<std::string, std::string> hosts;
+    std::ifstream                                 file( options_.hosts_file );
+    std::string                                   line;
+    while ( std::getline( file, line ) ) {
+        line = line.substr( 0, line.find( '#' ) );
+        std::istringstream stream( line );
+        std::string        address;
+        std::string        host;
+        if ( !( stream >> address ) || !IsNumericAddress( address ) ) {
+            continue;
+        }
+        while ( stream >> host ) {
+            // the first line for a host wins, as with the system resolver
+            hosts.emplace( ToLower( host ), address );
+        }
+    }
+    // entries of lines removed since go, the rest is replaced, pinned hosts and seeded entries are kept
+    for ( auto it = entries_.begin(); it != entries_.end(); ) {
+        it = it->second.hosts_file && hosts.count( it->first ) == 0 ? entries_.erase( it ) : std::next( it );
+    }
+    for ( auto &[host, address] : hosts ) {
+        auto &entry = entries_[host];
+        if ( entry.pinned || ( !entry.hosts_file && !entry.addresses.empty() && now < entry.expire ) ) {
+            continue;
+        }
+        entry.addresses.assign( 1, address );
+        entry.hosts_file = true;
+        entry.expire     = hosts_expire_;
+        entry.next       = 0;
+    }
+}
+
+bool DnsCache::StartQuery( Lookup *lookup ) {
+    evdns_request *request = nullptr;
+    if ( lookup->ipv6 ) {
+        request = evdns_base_resolve_ipv6( dns_, lookup->host.c_str(), 0, OnResolved, lookup );
+    }
+    else {
+        request = evdns_base_resolve_ipv4( dns_, lookup->host.c_str(), 0, OnResolved, lookup );
+    }
+    return request != nullptr;
+}
+
+void DnsCache::Finish( Lookup *lookup, const std::string &error ) {
+    lookups_.erase( lookup->host );
+    if ( !error.empty() ) {
+        auto &entry  = entries_[lookup->host];
+        entry.addresses.clear();
+        entry.pinned = false;
+        entry.expire = Clock::now() + std::chrono::seconds( options_.negative_ttl_s );
+    }
+    auto waiters = std::move( lookup->waiters );
+    for ( auto &[ticket, waiter] : waiters ) {
+        tickets_.erase( ticket );
+    }
+    std::string host = lookup->host;
+    delete lookup;
+    for ( auto &[ticket, waiter] : waiters ) {
+        if ( error.empty() ) {
+            auto &entry = entries_[host];
+            waiter( entry.addresses[entry.next++ % entry.addresses.size()], "" );
+        }
+        else {
+            waiter( "", "failed to resolve " + host + ": " + error );
+        }
+    }
+}
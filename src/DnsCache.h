@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct event_base;
+struct evdns_base;
+
+struct DnsOptions {
+    std::vector<std::string>           nameservers;               // "ip[:port]", empty to use the system resolver config
+    std::string                        hosts_file = "/etc/hosts";  // /etc/hosts format, empty to skip
+    std::map<std::string, std::string> hosts;                     // pinned host -> address, never expire
+    int                                min_ttl_s      = 1;
+    int                                max_ttl_s      = 300;
+    int                                negative_ttl_s = 5;        // failed lookups are remembered this long
+};
+
+/**
+ * @brief Non-blocking host name resolution on an evdns_base with a TTL-aware cache
+ * Must only be used from the thread running the event base. Concurrent lookups of the same name share one query,
+ * entries expire after the TTL of the DNS answer (clamped to [min_ttl_s, max_ttl_s]). Numeric addresses, pinned
+ * hosts and hosts file entries resolve without a query, the hosts file is read again once max_ttl_s have passed, so
+ * changes to it are picked up like a changed DNS answer.
+ */
+class DnsCache final {
+public:
+    // address is empty on failure, error says why
+    using Callback = std::function<void( const std::string &address, const std::string &error )>;
+
+    DnsCache( event_base *base, const DnsOptions &options );
+    DnsCache( const DnsCache & )            = delete;
+    DnsCache &operator=( const DnsCache & ) = delete;
+    ~DnsCache();
+
+    /**
+     * @brief Resolve host, callback runs before returning when the answer is known without a query
+     *
+     * @param host
+     * @param callback
+     * @return uint64_t 0 if callback has already run, otherwise a ticket for Cancel()
+     */
+    uint64_t Resolve( const std::string &host, Callback callback );
+
+    /**
+     * @brief Drop the callback of an unfinished Resolve(), the query itself keeps running for other waiters
+     *
+     * @param ticket
+     */
+    void Cancel( uint64_t ticket );
+
+    /**
+     * @brief Add or replace a cache entry
+     *
+     * @param host
+     * @param address numeric IPv4 or IPv6 address
+     * @param ttl_s <= 0 pins the entry
+     */
+    void Seed( const std::string &host, const std::string &address, int ttl_s );
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::vector<std::string> addresses;  // empty for a negative entry
+        Clock::time_point        expire;
+        bool                     pinned     = false;
+        bool                     hosts_file = false;  // from options.hosts_file, replaced when it is read again
+        size_t                   next       = 0;      // round robin over addresses
+    };
+
+    struct Lookup {
+        DnsCache                          *cache = nullptr;
+        std::string                        host;
+        bool                               ipv6 = false;
+        std::map<uint64_t, Callback>       waiters;
+    };
+
+    static void OnResolved( int result, char type, int count, int ttl, void *addresses, void *arg );
+
+    void LoadHostsFile();
+    bool StartQuery( Lookup *lookup );
+    void Finish( Lookup *lookup, const std::string &error );
+
+    evdns_base                                *dns_ = nullptr;
+    DnsOptions                                 options_;
+    std::unordered_map<std::string, Entry>     entries_;
+    std::unordered_map<std::string, Lookup *>  lookups_;
+    std::unordered_map<uint64_t, Lookup *>     tickets_;
+    uint64_t                                   next_ticket_ = 1;
+    Clock::time_point                          hosts_expire_;  // the hosts file is read again from then on
+};
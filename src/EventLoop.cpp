@@ -0,0 +1,201 @@
+#include "EventLoop.h"
+#include <event2/event.h>
+#ifdef __linux__
+    #include <sys/eventfd.h>
+    #include <unistd.h>
+#else
+    #include <sys/socket.h>
+#endif
+#include <stdexcept>
+#include <utility>
+
+EventLoop::EventLoop( const ConnectionPoolOptions &pool_options, const DnsOptions &dns_options ) {
+    // only the loop thread uses the base, other threads go through the task queue
+    auto *config = event_config_new();
+    if ( !config ) {
+        throw std::runtime_error( "Failed to create event config" );
+    }
+    event_config_set_flag( config, EVENT_BASE_FLAG_NOLOCK );
+    base_ = event_base_new_with_config( config );
+    event_config_free( config );
+    if ( !base_ ) {
+        throw std::runtime_error( "Failed to create event base" );
+    }
+    InitWakeup();
+    pool_   = std::make_unique<ConnectionPool>( base_, pool_options );
+    dns_    = std::make_unique<DnsCache>( base_, dns_options );
+    timers_ = std::make_unique<TimerWheel>( base_ );
+    Start();
+}
+
+EventLoop::EventLoop( event_base *base, const ConnectionPoolOptions &pool_options, const DnsOptions &dns_options )
+    : base_( base ) {
+    if ( base_ == nullptr ) {
+        throw std::invalid_argument( "event base can not be null" );
+    }
+    InitWakeup();
+    pool_   = std::make_unique<ConnectionPool>( base_, pool_options );
+    dns_    = std::make_unique<DnsCache>( base_, dns_options );
+    timers_ = std::make_unique<TimerWheel>( base_ );
+    // the thread driving the base is not known yet, the wakeup records it, see OnWakeup()
+    Wakeup();
+}
+
+EventLoop::~EventLoop() {
+    bool owns_base = worker_.joinable();
+    if ( owns_base ) {
+        Stop();
+    }
+    // tasks queued after the loop stopped are dropped without running
+    Task *task = tasks_.exchange( nullptr, std::memory_order_acquire );
+    while ( task != nullptr ) {
+        delete std::exchange( task, task->next );
+    }
+    timers_.reset();
+    dns_.reset();
+    pool_.reset();
+    if ( wakeup_event_ ) {
+        event_free( wakeup_event_ );
+        wakeup_event_ = nullptr;
+    }
+    evutil_closesocket( wakeup_fd_[0] );
+    if ( wakeup_fd_[1] != wakeup_fd_[0] ) {
+        evutil_closesocket( wakeup_fd_[1] );
+    }
+    if ( owns_base ) {
+        event_base_free( base_ );
+    }
+    base_ = nullptr;
+}
+
+event_base *EventLoop::Base() const {
+    return base_;
+}
+
+ConnectionPool &EventLoop::Pool() {
+    return *pool_;
+}
+
+DnsCache &EventLoop::Dns() {
+    return *dns_;
+}
+
+TimerWheel &EventLoop::Timers() {
+    return *timers_;
+}
+
+HttpMetrics &EventLoop::Metrics() {
+    return metrics_;
+}
+
+void EventLoop::RunInLoop( std::function<void()> task ) {
+    auto *node = new Task{ std::move( task ), nullptr };
+    auto *head = tasks_.load( std::memory_order_relaxed );
+    do {
+        node->next = head;
+    } while ( !tasks_.compare_exchange_weak( head, node, std::memory_order_release, std::memory_order_relaxed ) );
+    // only the push onto an empty queue wakes the loop, later pushes join the pending batch
+    if ( head == nullptr ) {
+        Wakeup();
+    }
+}
+
+bool EventLoop::IsInLoopThread() const {
+    return loop_thread_.load( std::memory_order_relaxed ) == std::this_thread::get_id();
+}
+
+bool EventLoop::IsLoopThreadKnown() const {
+    return loop_thread_.load( std::memory_order_relaxed ) != std::thread::id();
+}
+
+size_t EventLoop::Load() const {
+    return load_.load( std::memory_order_relaxed );
+}
+
+void EventLoop::AddLoad() {
+    load_.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void EventLoop::RemoveLoad() {
+    load_.fetch_sub( 1, std::memory_order_relaxed );
+}
+
+void EventLoop::OnWakeup( evutil_socket_t fd, short, void *arg ) {
+    auto *loop = reinterpret_cast<EventLoop *>( arg );
+    // reset the wakeup before taking the batch, a push racing with RunTasks then wakes the loop again
+#ifdef __linux__
+    eventfd_t value;
+    (void)eventfd_read( fd, &value );
+#else
+    char buf[64];
+    while ( recv( fd, buf, sizeof( buf ), 0 ) > 0 ) {
+    }
+#endif
+    loop->loop_thread_.store( std::this_thread::get_id(), std::memory_order_relaxed );
+    loop->RunTasks();
+}
+
+void EventLoop::InitWakeup() {
+#ifdef __linux__
+    wakeup_fd_[0] = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    wakeup_fd_[1] = wakeup_fd_[0];
+    if ( wakeup_fd_[0] < 0 ) {
+        throw std::runtime_error( "Failed to create eventfd" );
+    }
+#else
+    #ifdef _WIN32
+    int family = AF_INET;
+    #else
+    int family = AF_UNIX;
+    #endif
+    if ( evutil_socketpair( family, SOCK_STREAM, 0, wakeup_fd_ ) != 0 ) {
+        throw std::runtime_error( "Failed to create wakeup socket pair" );
+    }
+    evutil_make_socket_nonblocking( wakeup_fd_[0] );
+    evutil_make_socket_nonblocking( wakeup_fd_[1] );
+#endif
+    wakeup_event_ = event_new( base_, wakeup_fd_[0], EV_READ | EV_PERSIST, OnWakeup, this );
+    if ( wakeup_event_ == nullptr || event_add( wakeup_event_, nullptr ) != 0 ) {
+        throw std::runtime_error( "Failed to create wakeup event" );
+    }
+}
+
+void EventLoop::Wakeup() {
+#ifdef __linux__
+    (void)eventfd_write( wakeup_fd_[1], 1 );
+#else
+    char one = 1;
+    (void)send( wakeup_fd_[1], &one, 1, 0 );
+#endif
+}
+
+void EventLoop::RunTasks() {
+    Task *head = tasks_.exchange( nullptr, std::memory_order_acquire );
+    // restore submission order
+    Task *batch = nullptr;
+    while ( head != nullptr ) {
+        auto *next = head->next;
+        head->next = batch;
+        batch      = head;
+        head       = next;
+    }
+    while ( batch != nullptr ) {
+        std::unique_ptr<Task> task( std::exchange( batch, batch->next ) );
+        task->run();
+    }
+}
+
+void EventLoop::Start() {
+    worker_ = std::thread( [this]() {
+        // keeps running while idle, a request queued from another thread starts on the next wakeup
+        event_base_loop( base_, EVLOOP_NO_EXIT_ON_EMPTY );
+    } );
+    loop_thread_.store( worker_.get_id(), std::memory_order_relaxed );
+}
+
+void EventLoop::Stop() {
+    RunInLoop( [this]() { event_base_loopbreak( base_ ); } );
+    if ( worker_.joinable() ) {
+        worker_.join();
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include <event2/util.h>
+
+#include "ConnectionPool.h"
+#include "DnsCache.h"
+#include "HttpMetrics.h"
+#include "TimerWheel.h"
+
+struct event_base;
+struct event;
+
+/**
+ * @brief One libevent event_base with the connection state that belongs to it
+ * Either owns its event_base and drives it on a worker thread, or borrows an event_base driven by the user.
+ * Other threads hand work to the loop through a lock-free MPSC task queue, the loop is woken by an eventfd (a pipe
+ * where eventfd is not available) and runs all queued tasks in one batch, so the event_base itself is only touched
+ * from the loop thread and is created without libevent locking.
+ */
+class EventLoop final {
+public:
+    EventLoop( const ConnectionPoolOptions &pool_options, const DnsOptions &dns_options );
+    EventLoop( event_base *base, const ConnectionPoolOptions &pool_options, const DnsOptions &dns_options );
+    EventLoop( const EventLoop & )            = delete;
+    EventLoop &operator=( const EventLoop & ) = delete;
+    ~EventLoop();
+
+    event_base     *Base() const;
+    ConnectionPool &Pool();
+    DnsCache       &Dns();
+    TimerWheel     &Timers();
+    HttpMetrics    &Metrics();
+
+    /**
+     * @brief Queue task to run on the loop thread, safe to call from any thread
+     *
+     * @param task
+     */
+    void RunInLoop( std::function<void()> task );
+
+    /**
+     * @brief
+     * For a borrowed event_base the loop thread is known once the base has been driven, the constructor queues a
+     * wakeup that records it on the first turn of the loop. Until then this returns false and work is queued.
+     */
+    bool IsInLoopThread() const;
+    bool IsLoopThreadKnown() const;
+
+    // requests started on this loop and not finished yet
+    size_t Load() const;
+    void   AddLoad();
+    void   RemoveLoad();
+
+private:
+    struct Task {
+        std::function<void()> run;
+        Task                 *next = nullptr;
+    };
+
+    static void OnWakeup( evutil_socket_t fd, short, void *arg );
+
+    void InitWakeup();
+    void Wakeup();
+    void RunTasks();
+    void Start();
+    void Stop();
+
+    event_base                     *base_ = nullptr;
+    std::unique_ptr<ConnectionPool> pool_;
+    std::unique_ptr<DnsCache>       dns_;
+    std::unique_ptr<TimerWheel>     timers_;
+    HttpMetrics                     metrics_;
+    std::thread                     worker_;
+    std::atomic<std::thread::id>    loop_thread_;
+    std::atomic<size_t>             load_ = 0;
+
+    std::atomic<Task *> tasks_        = nullptr;  // pushed in LIFO order, reversed when drained
+    evutil_socket_t     wakeup_fd_[2] = { -1, -1 };  // read end, write end (the same fd for eventfd)
+    event              *wakeup_event_ = nullptr;
+};
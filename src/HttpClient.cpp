@@ -3,14 +3,24 @@
 #include <event2/bufferevent.h>
 #ifdef BUILD_WITH_SSL
     #include <event2/bufferevent_ssl.h>
+    #include <openssl/ssl.h>
 #endif
 #include <event2/event.h>
-#include <event2/thread.h>
 #include <event2/util.h>
 #include <evhttp.h>
+#include <fcntl.h>
 #include <string.h>
-#include <iostream>
-#include <thread>
+#ifdef _WIN32
+    #include <io.h>
+    #include <winsock2.h>
+#else
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <utility>
 
 #include "HttpUtils.h"
 
@@ -23,10 +33,27 @@
     using raii_##type = std::unique_ptr<struct type, type##_deleter>;
 
 EV_RAII( evhttp_request )
-EV_RAII( evhttp_connection )
 
 namespace {
 
+bool IsConnected( evhttp_connection *connection ) {
+    auto fd = bufferevent_getfd( evhttp_connection_get_bufferevent( connection ) );
+    if ( fd < 0 ) {
+        return false;
+    }
+    sockaddr_storage addr;
+    ev_socklen_t     len = sizeof( addr );
+    return getpeername( fd, reinterpret_cast<sockaddr *>( &addr ), &len ) == 0;
+}
+
+#ifdef BUILD_WITH_SSL
+// SSL ex data slot of the response that opened the connection, while it is in flight
+int TimingIndex() {
+    static int index = SSL_get_ex_new_index( 0, nullptr, nullptr, nullptr, nullptr );
+    return index;
+}
+#endif
+
 evhttp_cmd_type ToEvType( HttpRequest::Method method ) {
     switch ( method ) {
         case HttpRequest::Method::GET:
@@ -39,13 +66,126 @@ evhttp_cmd_type ToEvType( HttpRequest::Method method ) {
 
 }  // namespace
 
+int OnRequestHeader( evhttp_request *req, void *arg ) {
+    HttpResponse *resp       = reinterpret_cast<HttpResponse *>( arg );
+    resp->last_read_         = HttpResponse::Clock::now();
+    resp->timing_.first_byte = resp->last_read_;
+    if ( resp->decompress_ ) {
+        auto *encoding = evhttp_find_header( evhttp_request_get_input_headers( req ), "Content-Encoding" );
+        if ( encoding != nullptr ) {
+            resp->inflater_ = Inflater::Create( encoding );
+        }
+    }
+    // switch from the header deadline to the idle read deadline
+    HttpClient::ArmTimer( resp );
+    return 0;
+}
+
+void OnRequestWritten( evbuffer *buffer, const evbuffer_cb_info *info, void *arg ) {
+    if ( info->n_deleted == 0 ) {
+        return;
+    }
+    HttpResponse *resp   = reinterpret_cast<HttpResponse *>( arg );
+    auto         &timing = resp->timing_;
+    auto          now    = HttpResponse::Clock::now();
+    // a new plain connection writes as soon as it is connected, with TLS the handshake callback has set it
+    if ( !timing.connection_reused && timing.connected == HttpTiming::Clock::time_point() ) {
+        timing.connected = now;
+    }
+    if ( evbuffer_get_length( buffer ) == 0 ) {
+        timing.sent = now;
+        // the header deadline starts once the request is written, not while connecting or queued on the connection
+        if ( resp->last_read_ == HttpResponse::Clock::time_point() && resp->timeouts_.header_ms > 0 ) {
+            HttpClient::ArmTimer( resp );
+        }
+    }
+}
+
+void OnSSLInfo( const SSL *ssl, int where, int ) {
+#ifdef BUILD_WITH_SSL
+    auto *resp = reinterpret_cast<HttpResponse *>( SSL_get_ex_data( ssl, TimingIndex() ) );
+    if ( resp == nullptr ) {
+        return;
+    }
+    // OpenSSL reports post-handshake messages as handshakes too, only the first one counts
+    auto &timing = resp->timing_;
+    if ( ( where & SSL_CB_HANDSHAKE_START ) && timing.connected == HttpTiming::Clock::time_point() ) {
+        timing.connected = HttpTiming::Clock::now();
+    }
+    if ( ( where & SSL_CB_HANDSHAKE_DONE ) && timing.tls_done == HttpTiming::Clock::time_point() ) {
+        timing.tls_done = HttpTiming::Clock::now();
+    }
+#else
+    (void)ssl;
+    (void)where;
+#endif
+}
+
+void OnRequestChunk( evhttp_request *req, void *arg ) {
+    HttpResponse *resp   = reinterpret_cast<HttpResponse *>( arg );
+    auto         &origin = *resp->origin_;
+    auto         *buffer = evhttp_request_get_input_buffer( req );
+    resp->last_read_     = HttpResponse::Clock::now();
+    HttpMetrics::Host::Add( resp->metrics_->bytes_in, evbuffer_get_length( buffer ) );
+    if ( resp->inflater_ ) {
+        // a corrupt body is reported when the request is done, failing from inside evhttp's read is not safe
+        if ( resp->decode_error_ || !resp->inflater_->Inflate( buffer ) ) {
+            resp->decode_error_ = true;
+            evbuffer_drain( buffer, evbuffer_get_length( buffer ) );
+            return;
+        }
+        buffer = resp->inflater_->Output();
+    }
+    // evhttp drains the input buffer once this callback returns, the inflater's output is drained here
+    if ( origin.body_callback_ ) {
+        int n = evbuffer_peek( buffer, -1, nullptr, nullptr, 0 );
+        std::vector<evbuffer_iovec> segments( n > 0 ? n : 0 );
+        evbuffer_peek( buffer, -1, nullptr, segments.data(), n );
+        for ( auto &segment : segments ) {
+            origin.body_callback_( std::string_view( static_cast<const char *>( segment.iov_base ), segment.iov_len ) );
+        }
+        evbuffer_drain( buffer, evbuffer_get_length( buffer ) );
+    }
+    else if ( origin.body_stream_ ) {
+        origin.body_stream_->Push( resp->loop_, resp->connection_, buffer );
+    }
+    else {
+        // only set to track reads for the idle deadline, the body is collected as usual
+        resp->body_.Take( buffer );
+    }
+}
+
 void OnRequestDone( evhttp_request *req, void *arg ) {
     if ( arg == nullptr ) {
         return;
     }
     HttpResponse *resp = reinterpret_cast<HttpResponse *>( arg );
+    // evhttp frees the request once this callback returns
+    resp->request_ = nullptr;
+    if ( resp->connection_ ) {
+        auto *bufev = evhttp_connection_get_bufferevent( resp->connection_ );
+        if ( resp->write_cb_ ) {
+            evbuffer_remove_cb_entry( bufferevent_get_output( bufev ), std::exchange( resp->write_cb_, nullptr ) );
+        }
+#ifdef BUILD_WITH_SSL
+        auto *ssl = bufferevent_openssl_get_ssl( bufev );
+        if ( ssl != nullptr && SSL_get_ex_data( ssl, TimingIndex() ) == resp ) {
+            SSL_set_ex_data( ssl, TimingIndex(), nullptr );
+        }
+        resp->session_reused_        = SSLConfig::IsSessionReused( ssl );
+        resp->timing_.session_reused = resp->session_reused_;
+#endif
+    }
+    if ( resp->loop_ && resp->connection_ ) {
+        bool reusable = req != nullptr && evhttp_request_get_response_code( req ) > 0;
+        resp->loop_->Pool().Release( std::exchange( resp->connection_, nullptr ), reusable );
+        resp->loop_->RemoveLoad();
+    }
     if ( req == nullptr ) {
-        resp->promise_.set_value( true );
+        if ( resp->error_.empty() ) {
+            resp->error_ = "connection failed";
+        }
+        resp->Finish();
         return;
     }
     // HTTP version
@@ -61,14 +201,30 @@ void OnRequestDone( evhttp_request *req, void *arg ) {
     // response headers
     auto *headers = evhttp_request_get_input_headers( req );
     for ( evkeyval *header = headers->tqh_first; header != nullptr; header = header->next.tqe_next ) {
-        resp->header_[header->key] = header->value;
+        resp->header_.Add( header->key, header->value );
     }
     // response data
     auto *buffer = evhttp_request_get_input_buffer( req );
     if ( buffer ) {
-        size_t len = evbuffer_get_length( buffer );
-        resp->body_.resize( len );
-        evbuffer_copyout( buffer, resp->body_.data(), len );
+        HttpMetrics::Host::Add( resp->metrics_->bytes_in, evbuffer_get_length( buffer ) );
+    }
+    if ( resp->inflater_ ) {
+        if ( buffer && !resp->decode_error_ ) {
+            resp->decode_error_ = !resp->inflater_->Inflate( buffer );
+        }
+        buffer = resp->inflater_->Output();
+        // the body is handed out decoded, these would describe the encoded one
+        resp->header_.Remove( "Content-Encoding" );
+        resp->header_.Remove( "Content-Length" );
+        if ( resp->decode_error_ || !resp->inflater_->Complete() ) {
+            resp->status_code_ = -1;
+            resp->error_       = resp->decode_error_ ? "corrupt compressed body" : "truncated compressed body";
+            resp->Finish();
+            return;
+        }
+    }
+    if ( buffer ) {
+        resp->body_.Take( buffer );
     }
     // error message
     if ( !resp->IsSuccess() ) {
@@ -77,15 +233,19 @@ void OnRequestDone( evhttp_request *req, void *arg ) {
         error += "]; [SSL error: " + SSLConfig::SSLErrorString() + "]";
         resp->error_ = std::move( error );
     }
-    resp->promise_.set_value( true );
+    resp->Finish();
 }
 
 HttpRequest &HttpRequest::SetMethod( Method method ) {
+    DetachQuery();
     method_ = method;
     return *this;
 }
 
 HttpRequest &HttpRequest::SetFullUrl( const std::string &url ) {
+    DetachHeader();
+    DetachQuery();
+    host_header_.reset();
     UrlObject parser( url );
     auto      scheme = parser.Scheme();
     auto      host   = parser.Host();
@@ -116,46 +276,110 @@ HttpRequest &HttpRequest::SetScheme( const std::string &scheme ) {
 }
 
 HttpRequest &HttpRequest::SetHost( const std::string &host, uint16_t port ) {
+    host_header_.reset();
     host_ = host;
     port_ = port;
     return *this;
 }
 
 HttpRequest &HttpRequest::SetPath( const std::string &path ) {
+    DetachQuery();
     path_ = path;
     return *this;
 }
 
 HttpRequest &HttpRequest::SetHeader( const std::string &key, const std::string &value ) {
-    header_[key] = value;
+    DetachHeader();
+    header_.Set( key, value );
     return *this;
 }
 
-HttpRequest &HttpRequest::SetHeader( const std::map<std::string, std::string> &header ) {
+HttpRequest &HttpRequest::SetHeader( const HttpHeaders &header ) {
+    shared_header_.reset();
     header_ = header;
     return *this;
 }
 
+HttpRequest &HttpRequest::AddHeader( const std::string &key, const std::string &value ) {
+    DetachHeader();
+    header_.Add( key, value );
+    return *this;
+}
+
 HttpRequest &HttpRequest::SetQuery( const std::string &key, const std::string &value ) {
+    DetachQuery();
     query_[key] = value;
     return *this;
 }
 
 HttpRequest &HttpRequest::SetQuery( const std::map<std::string, std::string> &query ) {
+    shared_query_.reset();
     query_ = query;
     return *this;
 }
 
 HttpRequest &HttpRequest::SetBody( const std::string &body ) {
+    ClearBody();
     body_ = body;
     return *this;
 }
 
 HttpRequest &HttpRequest::SetBody( std::string &&body ) {
+    ClearBody();
     body_ = std::move( body );
     return *this;
 }
 
+HttpRequest &HttpRequest::SetBody( std::shared_ptr<const std::string> body ) {
+    ClearBody();
+    shared_body_ = std::move( body );
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetBodyFile( const std::string &path, int64_t offset, int64_t length ) {
+    ClearBody();
+    body_file_        = path;
+    body_file_offset_ = offset;
+    body_file_length_ = length;
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetBodyGenerator( BodyGenerator generator ) {
+    ClearBody();
+    body_generator_ = std::move( generator );
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetBodyCallback( BodyCallback callback ) {
+    body_callback_ = std::move( callback );
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetBodyStream( BodyStream::Ptr stream ) {
+    body_stream_ = std::move( stream );
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetTimeouts( const HttpTimeouts &timeouts ) {
+    timeouts_ = timeouts;
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetRetryPolicy( const RetryPolicy &policy ) {
+    retry_ = policy;
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetDecompress( bool decompress ) {
+    decompress_ = decompress;
+    return *this;
+}
+
+HttpRequest &HttpRequest::SetCompressBody( size_t min_size ) {
+    compress_body_min_ = min_size;
+    return *this;
+}
+
 HttpRequest::Method HttpRequest::GetMethod() const {
     return method_;
 }
@@ -176,23 +400,28 @@ const std::string &HttpRequest::GetPath() const {
     return path_;
 }
 
-const std::map<std::string, std::string> &HttpRequest::GetHeader() const {
-    return header_;
+const HttpHeaders &HttpRequest::GetHeader() const {
+    return shared_header_ ? *shared_header_ : header_;
 }
 
 std::string HttpRequest::GetHeader( const std::string &key ) const {
-    return header_.count( key ) > 0 ? header_.at( key ) : "";
+    return GetHeader().Get( key );
 }
 
 const std::map<std::string, std::string> &HttpRequest::GetQuery() const {
-    return query_;
+    return shared_query_ ? shared_query_->query : query_;
 }
 
 std::string HttpRequest::GetQuery( const std::string &key ) const {
-    return query_.count( key ) > 0 ? query_.at( key ) : "";
+    auto &query = GetQuery();
+    auto  it    = query.find( key );
+    return it != query.end() ? it->second : "";
 }
 
 std::string HttpRequest::GetUri() const {
+    if ( shared_query_ ) {
+        return shared_query_->uri;
+    }
     if ( method_ == Method::GET ) {
         return path_ + JoinQuery( query_ );
     }
@@ -200,7 +429,7 @@ std::string HttpRequest::GetUri() const {
 }
 
 const std::string &HttpRequest::GetBody() const {
-    return body_;
+    return shared_body_ ? *shared_body_ : body_;
 }
 
 std::string HttpRequest::ToString() const {
@@ -214,10 +443,10 @@ std::string HttpRequest::ToString() const {
     // Connection: keep-alive
     std::string ret =
         std::string( method_ == Method::GET ? "GET" : "POST" ) + " " + GetUri() + " " + EV_HTTP_VERSION + "\r\n";
-    for ( auto &[key, value] : header_ ) {
+    for ( auto &[key, value] : GetHeader() ) {
         ret += key + ": " + value + "\r\n";
     }
-    ret += "\r\n" + body_;
+    ret += "\r\n" + GetBody();
     return ret;
 }
 
@@ -228,24 +457,174 @@ evhttp_request *HttpRequest::ToEvRequest( DoneCallback &&cb, void *cb_arg ) cons
     }
     // header
     auto *req_headers = evhttp_request_get_output_headers( req.get() );
-    if ( header_.count( "Host" ) == 0 ) {
-        std::string host = host_ + ":" + std::to_string( port_ );
+    auto &header      = GetHeader();
+    if ( !header.Contains( "Host" ) ) {
+        std::string host = host_header_ ? *host_header_ : MakeHostHeader();
         evhttp_add_header( req_headers, "Host", host.c_str() );
     }
-    for ( auto &[key, value] : header_ ) {
+    for ( auto &[key, value] : header ) {
         evhttp_add_header( req_headers, key.c_str(), value.c_str() );
     }
     // data
     auto *req_buffer = evhttp_request_get_output_buffer( req.get() );
-    if ( method_ != Method::GET ) {
-        if ( evbuffer_add( req_buffer, body_.c_str(), body_.size() ) != 0 ) {
-            return nullptr;
-        }
+    if ( method_ != Method::GET && !AddBody( req_buffer ) ) {
+        return nullptr;
     }
     return req.release();
 }
 
-HttpResponse::HttpResponse() : future_( promise_.get_future() ) {}
+std::string HttpRequest::MakeHostHeader() const {
+    return host_ + ":" + std::to_string( port_ );
+}
+
+void HttpRequest::DetachHeader() {
+    if ( shared_header_ ) {
+        header_ = *shared_header_;
+        shared_header_.reset();
+    }
+}
+
+void HttpRequest::DetachQuery() {
+    if ( shared_query_ ) {
+        query_ = shared_query_->query;
+        shared_query_.reset();
+    }
+}
+
+void HttpRequest::CompressBody() {
+    // only for SetBody bodies, files and generators are sent as they are
+    size_t      min_size = std::exchange( compress_body_min_, 0 ).value_or( 0 );
+    auto       &body     = shared_body_ ? *shared_body_ : body_;
+    std::string compressed;
+    if ( method_ == Method::GET || min_size == 0 || body.size() < min_size ||
+         GetHeader().Contains( "Content-Encoding" ) || !GzipCompress( body, compressed ) ) {
+        return;
+    }
+    SetBody( std::make_shared<const std::string>( std::move( compressed ) ) );
+    SetHeader( "Content-Encoding", "gzip" );
+}
+
+void HttpRequest::ClearBody() {
+    body_.clear();
+    shared_body_.reset();
+    body_file_.clear();
+    body_file_offset_ = 0;
+    body_file_length_ = -1;
+    body_generator_   = nullptr;
+}
+
+bool HttpRequest::AddBody( evbuffer *buffer ) const {
+    if ( shared_body_ ) {
+        // the buffer refers to the string, which is released once the data has been written
+        auto *holder = new std::shared_ptr<const std::string>( shared_body_ );
+        auto  unref  = []( const void *, size_t, void *arg ) {
+            delete reinterpret_cast<std::shared_ptr<const std::string> *>( arg );
+        };
+        if ( evbuffer_add_reference( buffer, shared_body_->data(), shared_body_->size(), unref, holder ) != 0 ) {
+            delete holder;
+            return false;
+        }
+        return true;
+    }
+    if ( !body_file_.empty() ) {
+        return AddBodyFile( buffer );
+    }
+    if ( body_generator_ ) {
+        // the generator writes straight into the buffer's memory
+        while ( true ) {
+            evbuffer_iovec vec;
+            if ( evbuffer_reserve_space( buffer, 16384, &vec, 1 ) < 1 ) {
+                return false;
+            }
+            size_t n = body_generator_( static_cast<char *>( vec.iov_base ), vec.iov_len );
+            if ( n == 0 ) {
+                break;
+            }
+            vec.iov_len = std::min( n, vec.iov_len );
+            if ( evbuffer_commit_space( buffer, &vec, 1 ) != 0 ) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return evbuffer_add( buffer, body_.c_str(), body_.size() ) == 0;
+}
+
+bool HttpRequest::AddBodyFile( evbuffer *buffer ) const {
+#ifdef _WIN32
+    int fd = _open( body_file_.c_str(), _O_RDONLY | _O_BINARY );
+#else
+    int fd = open( body_file_.c_str(), O_RDONLY | O_CLOEXEC );
+#endif
+    if ( fd < 0 ) {
+        return false;
+    }
+    // the segment owns fd from here on, the region is mapped rather than copied into the buffer
+    auto *segment = evbuffer_file_segment_new( fd, body_file_offset_, body_file_length_, EVBUF_FS_CLOSE_ON_FREE );
+    if ( segment == nullptr ) {
+#ifdef _WIN32
+        _close( fd );
+#else
+        close( fd );
+#endif
+        return false;
+    }
+    int ret = evbuffer_add_file_segment( buffer, segment, 0, -1 );
+    evbuffer_file_segment_free( segment );
+    return ret == 0;
+}
+
+PreparedRequest::PreparedRequest( const HttpRequest &request ) : request_( request ) {
+    auto query              = std::make_shared<HttpRequest::SharedQuery>();
+    query->query            = request.GetQuery();
+    query->uri              = request.GetUri();
+    request_.shared_query_  = std::move( query );
+    request_.shared_header_ = std::make_shared<const HttpHeaders>( request.GetHeader() );
+    request_.host_header_   = std::make_shared<const std::string>( request.MakeHostHeader() );
+    request_.header_.Clear();
+    request_.query_.clear();
+}
+
+HttpRequest PreparedRequest::Instantiate() const {
+    return request_;
+}
+
+HttpTiming::Duration HttpTiming::Between( Clock::time_point from, Clock::time_point to ) {
+    if ( from == Clock::time_point() || to == Clock::time_point() ) {
+        return Duration::zero();
+    }
+    return std::chrono::duration_cast<Duration>( to - from );
+}
+
+HttpTiming::Duration HttpTiming::Queue() const {
+    return Between( queued, started );
+}
+
+HttpTiming::Duration HttpTiming::Dns() const {
+    return Between( started, dns_resolved );
+}
+
+HttpTiming::Duration HttpTiming::Connect() const {
+    return Between( dns_resolved, connected );
+}
+
+HttpTiming::Duration HttpTiming::Tls() const {
+    return Between( connected, tls_done );
+}
+
+HttpTiming::Duration HttpTiming::Wait() const {
+    return Between( sent, first_byte );
+}
+
+HttpTiming::Duration HttpTiming::Download() const {
+    return Between( first_byte, completed );
+}
+
+HttpTiming::Duration HttpTiming::Total() const {
+    return Between( queued, completed );
+}
+
+HttpResponse::HttpResponse() = default;
 
 HttpResponse::HttpResponse( HttpResponse &&other ) {
     *this = std::move( other );
@@ -256,25 +635,130 @@ HttpResponse &HttpResponse::operator=( HttpResponse &&other ) {
     other.is_done_ = false;
     promise_       = std::move( other.promise_ );
     future_        = std::move( other.future_ );
+    callback_      = std::move( other.callback_ );
+    executor_      = std::move( other.executor_ );
+
+    http_version_   = std::move( other.http_version_ );
+    status_code_    = other.status_code_;
+    status_phrase_  = std::move( other.status_phrase_ );
+    header_         = std::move( other.header_ );
+    body_           = std::move( other.body_ );
+    error_          = std::move( other.error_ );
+    session_reused_ = other.session_reused_;
+    timeout_        = other.timeout_;
+    timing_         = other.timing_;
+
+    // whatever other holds goes with it, so other neither cancels nor releases anything when destroyed
+    loop_         = std::exchange( other.loop_, nullptr );
+    origin_       = std::move( other.origin_ );
+    ssl_config_   = std::exchange( other.ssl_config_, nullptr );
+    cancelled_    = other.cancelled_;
+    dns_ticket_   = std::exchange( other.dns_ticket_, 0 );
+    connection_   = std::exchange( other.connection_, nullptr );
+    request_      = std::exchange( other.request_, nullptr );
+    write_cb_     = std::exchange( other.write_cb_, nullptr );
+    metrics_      = std::exchange( other.metrics_, nullptr );
+    parent_       = std::exchange( other.parent_, nullptr );
+    failure_      = other.failure_;
+    limiter_      = std::exchange( other.limiter_, nullptr );
+    limit_key_    = std::move( other.limit_key_ );
+    holds_slot_   = std::exchange( other.holds_slot_, false );
+    rejected_     = other.rejected_;
+    cache_        = std::exchange( other.cache_, nullptr );
+    cache_key_    = std::move( other.cache_key_ );
+    revalidating_ = std::move( other.revalidating_ );
+    from_cache_   = other.from_cache_;
+    coalescer_    = std::exchange( other.coalescer_, nullptr );
+    coalesce_key_ = std::move( other.coalesce_key_ );
+    coalesced_    = other.coalesced_;
+    flight_       = other.flight_;
 
-    status_code_ = other.status_code_;
-    body_        = std::move( other.body_ );
-    header_      = std::move( other.header_ );
-    connection_  = std::exchange( other.connection_, nullptr );
-    request_     = std::exchange( other.request_, nullptr );
+    timeouts_        = other.timeouts_;
+    timer_           = std::exchange( other.timer_, 0 );
+    started_         = other.started_;
+    connect_started_ = other.connect_started_;
+    last_read_       = other.last_read_;
+    retry_           = std::exchange( other.retry_, nullptr );
+    budget_          = std::exchange( other.budget_, nullptr );
+    attempts_        = std::move( other.attempts_ );
+    attempt_count_   = other.attempt_count_;
+    retry_timer_     = std::exchange( other.retry_timer_, 0 );
+    decompress_      = other.decompress_;
+    decode_error_    = other.decode_error_;
+    inflater_        = std::move( other.inflater_ );
     return *this;
 }
 
 HttpResponse::~HttpResponse() {
-    if ( request_ ) {
-        evhttp_cancel_request( request_ );
-        evhttp_request_free( request_ );
-        request_ = nullptr;
+    if ( loop_ && !IsDone() ) {
+        // an unfinished request is failed by the cancel on the loop thread, which hands its connection back to the
+        // pool, the callback must have run before this object goes away
+        HttpClient::Cancel( this );
+        WaitForDone();
+    }
+}
+
+void HttpResponse::Finish() {
+    timing_.completed = Clock::now();
+    if ( cache_ && !parent_ ) {
+        HttpClient::UpdateCache( this );
+    }
+    if ( holds_slot_ ) {
+        holds_slot_ = false;
+        // the next request may run on another loop, it is dispatched there like a new one
+        if ( auto *next = limiter_->Release( limit_key_ ) ) {
+            next->holds_slot_ = true;
+            next->loop_->RunInLoop( [next]() { HttpClient::Dispatch( next ); } );
+        }
+    }
+    if ( metrics_ && !parent_ ) {
+        // attempts only count towards the response they were sent for, a flight towards the callers it answers
+        HttpMetrics::Host::Add( metrics_->retries, std::max( attempt_count_ - 1, 0 ) );
+        metrics_->in_flight.fetch_sub( 1, std::memory_order_relaxed );
+        if ( !flight_ ) {
+            HttpMetrics::Host::Add( metrics_->requests );
+            if ( status_code_ <= 0 ) {
+                HttpMetrics::Host::Add( metrics_->errors[static_cast<size_t>( Failure() )] );
+            }
+            metrics_->AddLatency( status_code_, timing_.Total() );
+        }
+    }
+    if ( timer_ ) {
+        loop_->Timers().Cancel( std::exchange( timer_, 0 ) );
+    }
+    if ( retry_timer_ ) {
+        loop_->Timers().Cancel( std::exchange( retry_timer_, 0 ) );
     }
-    if ( connection_ ) {
-        evhttp_connection_free( connection_ );
-        connection_ = nullptr;
+    retry_ = nullptr;
+    if ( origin_ && origin_->body_stream_ ) {
+        origin_->body_stream_->Close();
     }
+    origin_.reset();
+    if ( !callback_ ) {
+        promise_->set_value( true );
+        return;
+    }
+    is_done_      = true;
+    auto callback = std::move( callback_ );
+    auto executor = std::move( executor_ );
+    if ( !executor ) {
+        callback( Ptr( this ) );
+        return;
+    }
+    executor( [callback = std::move( callback ), response = this]() { callback( Ptr( response ) ); } );
+}
+
+RequestError HttpResponse::Failure() const {
+    if ( timeout_ ) {
+        return RequestError::Timeout;
+    }
+    if ( cancelled_ ) {
+        return RequestError::Cancelled;
+    }
+    if ( decode_error_ ) {
+        return RequestError::Decode;
+    }
+    return failure_.value_or( RequestError::Connection );
 }
 
 bool HttpResponse::IsDone() {
@@ -309,16 +793,19 @@ const std::string &HttpResponse::StatusPhrase() const {
 }
 
 const std::string &HttpResponse::Body() const {
+    return body_.String();
+}
+
+const ResponseBody &HttpResponse::BodyBuffer() const {
     return body_;
 }
 
-const std::map<std::string, std::string> &HttpResponse::Header() const {
+const HttpHeaders &HttpResponse::Header() const {
     return header_;
 }
 
 std::string HttpResponse::Header( const std::string &key ) const {
-    auto it = header_.find( key );
-    return it != header_.end() ? it->second : "";
+    return header_.Get( key );
 }
 
 bool HttpResponse::IsSuccess() const {
@@ -329,6 +816,26 @@ const std::string &HttpResponse::ErrorString() const {
     return error_;
 }
 
+bool HttpResponse::IsSessionReused() const {
+    return session_reused_;
+}
+
+bool HttpResponse::IsTimeout() const {
+    return timeout_;
+}
+
+bool HttpResponse::IsFromCache() const {
+    return from_cache_;
+}
+
+bool HttpResponse::IsCoalesced() const {
+    return coalesced_;
+}
+
+const HttpTiming &HttpResponse::Timing() const {
+    return timing_;
+}
+
 std::string HttpResponse::ToString() const {
     // e.g.
 
@@ -353,130 +860,888 @@ std::string HttpResponse::ToString() const {
     for ( auto &[key, value] : header_ ) {
         ret += key + ": " + value + "\r\n";
     }
-    ret += "\r\n" + body_;
+    ret += "\r\n" + body_.String();
     return ret;
 }
 
-HttpClient::HttpClient() {
-    StartEventLoop();
+BatchResponse::BatchResponse( size_t size )
+    : future_( promise_.get_future() ), remaining_( size ), responses_( size ), requests_( size ) {
+    if ( size == 0 ) {
+        promise_.set_value();
+    }
 }
 
-HttpClient::HttpClient( event_base *base ) : base_( base ) {
-    if ( base_ == nullptr ) {
-        throw std::invalid_argument( "event base can not be null" );
+BatchResponse::~BatchResponse() {
+    if ( !IsDone() ) {
+        // finished responses are kept in responses_ until here, so cancelling them is harmless
+        for ( auto *response : requests_ ) {
+            HttpClient::Cancel( response );
+        }
+        WaitForDone();
     }
 }
 
-HttpClient::~HttpClient() {
-    if ( running_ && base_ ) {
-        StopEventLoop();
+bool BatchResponse::IsDone() {
+    if ( !is_done_ ) {
+        is_done_ = WaitFor( 0 );
     }
+    return is_done_;
 }
 
-HttpResponse::Ptr HttpClient::Send( const HttpRequest &request ) {
-    HttpResponse::Ptr response( new HttpResponse() );
-    // connection
-    raii_evhttp_connection connection(
-        evhttp_connection_base_new( base_, nullptr, request.GetHost().c_str(), request.GetPort() ) );
-    if ( !connection ) {
-        return nullptr;
+void BatchResponse::WaitForDone() {
+    if ( !is_done_ ) {
+        future_.wait();
+        is_done_ = true;
     }
-    // request
-    raii_evhttp_request req( request.ToEvRequest( OnRequestDone, response.get() ) );
-    if ( !req ) {
-        return nullptr;
+}
+
+bool BatchResponse::WaitFor( int timeout_ms ) {
+    if ( !is_done_ && future_.wait_for( std::chrono::milliseconds( timeout_ms ) ) == std::future_status::ready ) {
+        is_done_ = true;
     }
-    evhttp_request_own( req.get() );
-    evhttp_request_set_error_cb( req.get(), []( evhttp_request_error error, void * ) {
-        std::cerr << "http request error: " << error << std::endl;
-    } );
-    if ( evhttp_make_request( connection.get(), req.get(), ToEvType( request.GetMethod() ),
-                              request.GetUri().c_str() ) != 0 ) {
-        return nullptr;
+    return is_done_;
+}
+
+size_t BatchResponse::Size() const {
+    return responses_.size();
+}
+
+HttpResponse &BatchResponse::At( size_t index ) {
+    return *responses_.at( index );
+}
+
+void BatchResponse::Complete( size_t index, HttpResponse::Ptr response ) {
+    responses_[index] = std::move( response );
+    if ( --remaining_ == 0 ) {
+        promise_.set_value();
     }
-    // all success
-    response->connection_ = connection.release();
-    response->request_    = req.release();
+}
+
+HttpClient::HttpClient() : HttpClient( HttpClientOptions() ) {}
+
+HttpClient::HttpClient( const HttpClientOptions &options )
+    : options_( options ),
+      retry_budget_( std::make_unique<RetryBudget>( options_.retry.budget_ratio, options_.retry.budget_min ) ) {
+    if ( RequestLimiter::Enabled( options_.limits ) ) {
+        limiter_ = std::make_unique<RequestLimiter>( options_.limits );
+    }
+    if ( ResponseCache::Enabled( options_.cache ) ) {
+        cache_ = std::make_unique<ResponseCache>( options_.cache );
+    }
+    if ( RequestCoalescer::Enabled( options_.coalesce ) ) {
+        coalescer_ = std::make_unique<RequestCoalescer>();
+    }
+    size_t count = std::max<size_t>( options_.event_loops, 1 );
+    for ( size_t i = 0; i < count; ++i ) {
+        loops_.push_back( std::make_unique<EventLoop>( options_.pool, options_.dns ) );
+    }
+}
+
+HttpClient::HttpClient( event_base *base ) : HttpClient( base, HttpClientOptions() ) {}
+
+HttpClient::HttpClient( event_base *base, const HttpClientOptions &options )
+    : options_( options ),
+      retry_budget_( std::make_unique<RetryBudget>( options_.retry.budget_ratio, options_.retry.budget_min ) ) {
+    if ( RequestLimiter::Enabled( options_.limits ) ) {
+        limiter_ = std::make_unique<RequestLimiter>( options_.limits );
+    }
+    if ( ResponseCache::Enabled( options_.cache ) ) {
+        cache_ = std::make_unique<ResponseCache>( options_.cache );
+    }
+    if ( RequestCoalescer::Enabled( options_.coalesce ) ) {
+        coalescer_ = std::make_unique<RequestCoalescer>();
+    }
+    loops_.push_back( std::make_unique<EventLoop>( base, options_.pool, options_.dns ) );
+}
+
+HttpClient::~HttpClient() = default;
+
+MetricsSnapshot HttpClient::Metrics() const {
+    MetricsSnapshot snapshot;
+    for ( auto &loop : loops_ ) {
+        loop->Metrics().Collect( snapshot );
+    }
+    return snapshot;
+}
+
+HttpResponse::Ptr HttpClient::Send( const HttpRequest &request ) {
+    HttpResponse::Ptr response( new HttpResponse() );
+    response->promise_.emplace();
+    response->future_ = response->promise_->get_future();
+    Submit( request, nullptr, response.get() );
     return response;
 }
 
 HttpResponse::Ptr HttpClient::Send( const HttpRequest &request, SSLConfig &ssl_config ) {
 #ifdef BUILD_WITH_SSL
-    std::cerr << request.GetHost() << " " << request.GetPort() << " " << request.GetScheme() << " " << request.GetPath()
-              << std::endl;
-
     HttpResponse::Ptr response( new HttpResponse() );
-    // buffer
-    bufferevent *bufev = nullptr;
-    if ( request.GetScheme() != "https" ) {
-        bufev = bufferevent_socket_new( base_, -1, BEV_OPT_CLOSE_ON_FREE );
+    response->promise_.emplace();
+    response->future_ = response->promise_->get_future();
+    Submit( request, &ssl_config, response.get() );
+    return response;
+#else
+    (void)ssl_config;
+    return Send( request );
+#endif
+}
+
+void HttpClient::Send( const HttpRequest &request, HttpResponse::Callback callback, HttpResponse::Executor executor ) {
+    // owned by the loop until handed to the callback
+    auto *response      = new HttpResponse();
+    response->callback_ = std::move( callback );
+    response->executor_ = std::move( executor );
+    Submit( request, nullptr, response );
+}
+
+void HttpClient::Send( const HttpRequest &request, SSLConfig &ssl_config, HttpResponse::Callback callback,
+                       HttpResponse::Executor executor ) {
+#ifdef BUILD_WITH_SSL
+    auto *response      = new HttpResponse();
+    response->callback_ = std::move( callback );
+    response->executor_ = std::move( executor );
+    Submit( request, &ssl_config, response );
+#else
+    (void)ssl_config;
+    Send( request, std::move( callback ), std::move( executor ) );
+#endif
+}
+
+#ifdef BUILD_WITH_COROUTINE
+SendAwaiter HttpClient::AsyncSend( const HttpRequest &request, HttpResponse::Executor executor ) {
+    return SendAwaiter( *this, request, nullptr, std::move( executor ) );
+}
+
+SendAwaiter HttpClient::AsyncSend( const HttpRequest &request, SSLConfig &ssl_config, HttpResponse::Executor executor ) {
+    return SendAwaiter( *this, request, &ssl_config, std::move( executor ) );
+}
+
+SendAwaiter::SendAwaiter( HttpClient &client, const HttpRequest &request, SSLConfig *ssl_config,
+                          HttpResponse::Executor executor )
+    : client_( &client ), request_( request ), ssl_config_( ssl_config ), executor_( std::move( executor ) ) {}
+
+bool SendAwaiter::await_suspend( std::coroutine_handle<> handle ) {
+    // the callback may run before Send returns, e.g. for a fresh cached response or a request failed right away on
+    // the loop thread, the coroutine must then go on from here instead of being resumed inside Send
+    auto callback = [this, handle]( HttpResponse::Ptr response ) {
+        response_ = std::move( response );
+        if ( done_.exchange( true ) ) {
+            handle.resume();
+        }
+    };
+    if ( ssl_config_ ) {
+        client_->Send( request_, *ssl_config_, std::move( callback ), std::move( executor_ ) );
     }
     else {
-        auto *ssl = ssl_config.CreateSSL( request.GetHost() );
-        if ( ssl == nullptr ) {
-            return nullptr;
+        client_->Send( request_, std::move( callback ), std::move( executor_ ) );
+    }
+    return !done_.exchange( true );
+}
+#endif
+
+BatchResponse::Ptr HttpClient::SendBatch( const std::vector<HttpRequest> &requests ) {
+    return SubmitBatch( requests, nullptr );
+}
+
+BatchResponse::Ptr HttpClient::SendBatch( const std::vector<HttpRequest> &requests, SSLConfig &ssl_config ) {
+#ifdef BUILD_WITH_SSL
+    return SubmitBatch( requests, &ssl_config );
+#else
+    (void)ssl_config;
+    return SendBatch( requests );
+#endif
+}
+
+BatchResponse::Ptr HttpClient::SubmitBatch( const std::vector<HttpRequest> &requests, SSLConfig *ssl_config ) {
+    BatchResponse::Ptr batch( new BatchResponse( requests.size() ) );
+    // group by host, so each host's requests reach its loop in one task and line up on its pooled connections
+    std::unordered_map<std::string, std::vector<size_t>> groups;
+    for ( size_t i = 0; i < requests.size(); ++i ) {
+        auto &request = requests[i];
+        groups[ConnectionPool::MakeKey( request.GetScheme(), request.GetHost(), request.GetPort() )].push_back( i );
+    }
+    for ( auto &[key, indexes] : groups ) {
+        auto                       *loop = SelectLoop( requests[indexes.front()] );
+        std::vector<HttpResponse *> group;
+        group.reserve( indexes.size() );
+        for ( auto index : indexes ) {
+            auto *response      = new HttpResponse();
+            response->callback_ = [batch = batch.get(), index]( HttpResponse::Ptr done ) {
+                batch->Complete( index, std::move( done ) );
+            };
+            batch->requests_[index] = response;
+            if ( ServeFromCache( requests[index], response ) ) {
+                continue;
+            }
+            auto *sent = Coalesce( loop, requests[index], ssl_config, response );
+            if ( sent == nullptr ) {
+                continue;
+            }
+            Prepare( loop, requests[index], ssl_config, sent );
+            if ( Admit( sent ) ) {
+                group.push_back( sent );
+            }
+        }
+        if ( loop->IsInLoopThread() ) {
+            for ( auto *response : group ) {
+                Dispatch( response );
+            }
+        }
+        else {
+            loop->RunInLoop( [group = std::move( group )]() {
+                for ( auto *response : group ) {
+                    Dispatch( response );
+                }
+            } );
         }
-        bufev = bufferevent_openssl_socket_new( base_, -1, ssl, BUFFEREVENT_SSL_CONNECTING,
-                                                BEV_OPT_CLOSE_ON_FREE | BEV_OPT_DEFER_CALLBACKS );
     }
-    if ( !bufev ) {
-        return nullptr;
+    return batch;
+}
+
+void HttpClient::Prepare( EventLoop *loop, const HttpRequest &request, SSLConfig *ssl_config,
+                          HttpResponse *response ) const {
+    response->timeouts_   = request.timeouts_ ? *request.timeouts_ : options_.timeouts;
+    response->loop_       = loop;
+    response->origin_     = std::make_unique<HttpRequest>( request );
+    response->ssl_config_ = ssl_config;
+    response->timing_.queued = HttpTiming::Clock::now();
+    response->decompress_ = request.decompress_.value_or( options_.decompress ) && *Inflater::AcceptEncoding() != '\0';
+    loop->AddLoad();
+    // a streamed body may have been partly delivered when an attempt fails, so it is never retried
+    auto &origin = *response->origin_;
+    if ( auto &stale = response->revalidating_ ) {
+        // a 304 to these refreshes the stale entry, see UpdateCache()
+        if ( auto *etag = stale->header.Find( "ETag" ) ) {
+            origin.SetHeader( "If-None-Match", *etag );
+        }
+        if ( auto *modified = stale->header.Find( "Last-Modified" ) ) {
+            origin.SetHeader( "If-Modified-Since", *modified );
+        }
     }
-    bufferevent_openssl_set_allow_dirty_shutdown( bufev, 1 );
-    // connection
-    raii_evhttp_connection connection(
-        evhttp_connection_base_bufferevent_new( base_, nullptr, bufev, request.GetHost().c_str(), request.GetPort() ) );
-    if ( !connection ) {
+    if ( !origin.compress_body_min_ ) {
+        origin.compress_body_min_ = options_.compress_body_min;
+    }
+    auto &policy = origin.retry_ ? *origin.retry_ : options_.retry;
+    if ( origin.GetMethod() == HttpRequest::GET && !origin.body_callback_ && !origin.body_stream_ &&
+         ( policy.max_attempts > 1 || policy.hedge_after_ms > 0 ) ) {
+        response->retry_  = &policy;
+        response->budget_ = retry_budget_.get();
+    }
+    retry_budget_->Deposit();
+}
+
+void HttpClient::Submit( const HttpRequest &request, SSLConfig *ssl_config, HttpResponse *response ) {
+    if ( ServeFromCache( request, response ) ) {
+        return;
+    }
+    auto *loop = SelectLoop( request );
+    response   = Coalesce( loop, request, ssl_config, response );
+    if ( response == nullptr ) {
+        return;
+    }
+    Prepare( loop, request, ssl_config, response );
+    if ( !Admit( response ) ) {
+        return;
+    }
+    if ( loop->IsInLoopThread() ) {
+        Dispatch( response );
+    }
+    else {
+        // pooled connections are shared between requests, so evhttp is only ever touched from the loop thread
+        loop->RunInLoop( [response]() { Dispatch( response ); } );
+    }
+}
+
+bool HttpClient::Admit( HttpResponse *response ) {
+    if ( !limiter_ ) {
+        return true;
+    }
+    auto &request        = *response->origin_;
+    response->limiter_   = limiter_.get();
+    response->limit_key_ = ConnectionPool::MakeKey( request.GetScheme(), request.GetHost(), request.GetPort() );
+    // a loop thread must not block, it would stall the requests that free the slots. The thread driving a borrowed
+    // event_base may not be known yet, it could be this one
+    bool may_block = std::none_of( loops_.begin(), loops_.end(), []( const std::unique_ptr<EventLoop> &loop ) {
+        return loop->IsInLoopThread() || !loop->IsLoopThreadKnown();
+    } );
+    switch ( limiter_->Admit( response->limit_key_, response, may_block ) ) {
+        case RequestLimiter::Admission::Start:
+            response->holds_slot_ = true;
+            return true;
+        case RequestLimiter::Admission::Queued:
+            return false;
+        case RequestLimiter::Admission::Rejected:
+        default:
+            response->rejected_ = true;
+            return true;
+    }
+}
+
+bool HttpClient::ServeFromCache( const HttpRequest &request, HttpResponse *response ) const {
+    if ( !cache_ ) {
+        return false;
+    }
+    auto key = ConnectionPool::MakeKey( request.GetScheme(), request.GetHost(), request.GetPort() ) + request.GetUri();
+    if ( request.GetMethod() != HttpRequest::GET ) {
+        // only to invalidate the entries once the request succeeded
+        response->cache_     = cache_.get();
+        response->cache_key_ = std::move( key );
+        return false;
+    }
+    // the decoded body is stored without Content-Encoding, so it must not answer a request that keeps it encoded
+    key += request.decompress_.value_or( options_.decompress ) ? "\n1" : "\n0";
+    // a streamed body is never collected, so there is nothing to store or to stream from
+    auto use = ResponseCache::UseFor( request.GetHeader() );
+    if ( request.body_callback_ || request.body_stream_ || use == ResponseCache::Use::Bypass ) {
+        return false;
+    }
+    auto entry           = cache_->Find( key, request.GetHeader() );
+    response->cache_     = cache_.get();
+    response->cache_key_ = std::move( key );
+    if ( !entry ) {
+        return false;
+    }
+    if ( use == ResponseCache::Use::Fresh && entry->IsFresh( CachedResponse::Clock::now() ) ) {
+        // finished right here, Finish() needs neither the loop nor the origin request
+        response->cache_         = nullptr;
+        response->timing_.queued = HttpTiming::Clock::now();
+        FillFromCache( response, *entry );
+        response->Finish();
+        return true;
+    }
+    if ( entry->HasValidator() ) {
+        response->revalidating_ = std::move( entry );
+    }
+    return false;
+}
+
+HttpResponse *HttpClient::Coalesce( EventLoop *loop, const HttpRequest &request, SSLConfig *ssl_config,
+                                    HttpResponse *response ) const {
+    if ( !coalescer_ || request.GetMethod() != HttpRequest::GET || request.body_callback_ || request.body_stream_ ) {
+        return response;
+    }
+    // everything that makes the response differ, the decoded body differs from the encoded one
+    auto key = ConnectionPool::MakeKey( request.GetScheme(), request.GetHost(), request.GetPort() ) + request.GetUri();
+    key += request.decompress_.value_or( options_.decompress ) ? "\n1" : "\n0";
+    if ( ssl_config != nullptr ) {
+        key += "\n" + std::to_string( reinterpret_cast<uintptr_t>( ssl_config ) );
+    }
+    for ( auto &name : options_.coalesce.key_fields ) {
+        key += '\n';
+        for ( auto &field : request.GetHeader() ) {
+            if ( HttpHeaders::EqualsIgnoreCase( field.name, name ) ) {
+                key += field.value;
+                key += '\r';
+            }
+        }
+    }
+    // taken from response first, it may be finished and gone as soon as it has joined
+    auto *cache     = std::exchange( response->cache_, nullptr );
+    auto  cache_key = std::move( response->cache_key_ );
+    auto  stale     = std::move( response->revalidating_ );
+    // set before joining, the wait is cancelled on the flight's loop, which is the same for the whole flight
+    response->loop_          = loop;
+    response->timing_.queued = HttpTiming::Clock::now();
+    response->coalescer_     = coalescer_.get();
+    response->coalesce_key_  = key;
+    response->coalesced_     = true;
+    if ( coalescer_->Join( key, response ) ) {
         return nullptr;
     }
+    response->coalesced_ = false;
+    // the first caller, the request is sent by a response of its own, which goes on when this one is cancelled
+    auto *flight      = new HttpResponse();
+    flight->flight_   = true;
+    flight->callback_ = [coalescer = coalescer_.get(), key = std::move( key )]( HttpResponse::Ptr done ) {
+        OnFlightDone( coalescer, key, std::move( done ) );
+    };
+    flight->cache_        = cache;
+    flight->cache_key_    = std::move( cache_key );
+    flight->revalidating_ = std::move( stale );
+    return flight;
+}
+
+void HttpClient::OnFlightDone( RequestCoalescer *coalescer, const std::string &key, HttpResponse::Ptr flight ) {
+    // joins from here on send again, the response may be old news to them
+    auto waiting = coalescer->Land( key );
+    for ( auto *response : waiting ) {
+        response->http_version_   = flight->http_version_;
+        response->status_code_    = flight->status_code_;
+        response->status_phrase_  = flight->status_phrase_;
+        response->header_         = flight->header_;
+        response->error_          = flight->error_;
+        response->session_reused_ = flight->session_reused_;
+        response->timeout_        = flight->timeout_;
+        response->failure_        = flight->status_code_ <= 0 ? std::optional( flight->Failure() ) : std::nullopt;
+        response->from_cache_     = flight->from_cache_;
+        auto queued               = response->timing_.queued;
+        response->timing_         = flight->timing_;
+        response->timing_.queued  = queued;
+        // a caller that joined late did not wait for what happened before
+        auto &timing = response->timing_;
+        for ( auto *point : { &timing.started, &timing.dns_resolved, &timing.connected, &timing.tls_done, &timing.sent,
+                              &timing.first_byte } ) {
+            if ( *point < queued ) {
+                *point = HttpTiming::Clock::time_point();
+            }
+        }
+        // the body is the same immutable one for every caller, never copied per caller
+        flight->body_.ShareWith( response->body_ );
+        // counted by Finish() as a request of the flight's host, as if dispatched with it
+        if ( ( response->metrics_ = flight->metrics_ ) ) {
+            response->metrics_->in_flight.fetch_add( 1, std::memory_order_relaxed );
+        }
+        response->Finish();
+    }
+}
+
+void HttpClient::UpdateCache( HttpResponse *response ) {
+    auto *cache   = std::exchange( response->cache_, nullptr );
+    auto  stale   = std::move( response->revalidating_ );
+    auto &request = *response->origin_;
+    auto &key     = response->cache_key_;
+    int   status  = response->status_code_;
+    if ( request.GetMethod() != HttpRequest::GET ) {
+        // RFC 9111 4.4, a successful unsafe request invalidates what is stored for its URI, decoded or not
+        if ( status >= 200 && status < 400 ) {
+            cache->Erase( key + "\n0" );
+            cache->Erase( key + "\n1" );
+        }
+        return;
+    }
+    if ( status == 304 && stale ) {
+        // the stored body is still good for this request, even if the 304 does not allow storing it any longer
+        auto entry = ResponseCache::Revalidated( *stale, request.GetHeader(), response->header_ );
+        if ( entry ) {
+            cache->Store( key, entry );
+        }
+        else {
+            cache->Erase( key );
+        }
+        FillFromCache( response, entry ? *entry : *stale );
+        return;
+    }
+    if ( status <= 0 || status >= 500 ) {
+        // the stored entry is kept, the server may recover before it expires
+        return;
+    }
+    auto entry = ResponseCache::Make( request.GetHeader(), status, response->header_ );
+    if ( !entry || response->body_.Size() >= cache->MaxEntryBytes() ) {
+        cache->Erase( key );
+        return;
+    }
+    auto body = std::make_shared<std::string>();
+    body->reserve( response->body_.Size() );
+    for ( auto segment : response->body_.Segments() ) {
+        body->append( segment );
+    }
+    entry->http_version  = response->http_version_;
+    entry->status_phrase = response->status_phrase_;
+    entry->body          = body;
+    cache->Store( key, std::move( entry ) );
+    // the response refers to the stored copy, so Body() needs no copy of its own
+    response->body_.Share( std::move( body ) );
+}
+
+void HttpClient::FillFromCache( HttpResponse *response, const CachedResponse &entry ) {
+    response->http_version_  = entry.http_version;
+    response->status_code_   = entry.status_code;
+    response->status_phrase_ = entry.status_phrase;
+    response->header_        = entry.header;
+    response->header_.Set( "Age", std::to_string( entry.Age( CachedResponse::Clock::now() ) ) );
+    response->body_ = ResponseBody();
+    if ( entry.body && !entry.body->empty() ) {
+        response->body_.Share( entry.body );
+    }
+    else if ( entry.mapped ) {
+        // pages of the file are read in as the body is
+        response->body_.Refer( entry.mapped->Data(), entry.mapped );
+    }
+    response->from_cache_ = true;
+}
+
+void HttpClient::Dispatch( HttpResponse *response ) {
+    auto &request  = *response->origin_;
+    bool  is_https = response->ssl_config_ != nullptr && request.GetScheme() == "https";
+    auto  key      = ConnectionPool::MakeKey( is_https ? "https" : "http", request.GetHost(), request.GetPort() );
+    auto *loop     = response->loop_;
+    response->metrics_ = loop->Metrics().Get( key );
+    if ( !response->parent_ ) {
+        response->metrics_->in_flight.fetch_add( 1, std::memory_order_relaxed );
+    }
+    if ( response->cancelled_ ) {
+        Fail( response, "request cancelled" );
+        return;
+    }
+    if ( response->rejected_ ) {
+        response->failure_ = RequestError::Rejected;
+        Fail( response, "too many requests queued" );
+        return;
+    }
+    // on the loop thread, so the caller never pays for it, and once, attempts share the result
+    request.CompressBody();
+    response->started_        = HttpResponse::Clock::now();
+    response->timing_.started = response->started_;
+    ArmTimer( response );
+    if ( response->retry_ ) {
+        StartAttempt( response );
+        return;
+    }
+    if ( auto *connection = loop->Pool().Acquire( key ) ) {
+        response->timing_.connection_reused = true;
+        HttpMetrics::Host::Add( response->metrics_->pool_hits );
+        MakeRequest( response, connection );
+        return;
+    }
+    // a new connection is needed, resolve the host without blocking the loop
+    response->dns_ticket_ = loop->Dns().Resolve(
+        request.GetHost(), [response, key]( const std::string &address, const std::string &error ) {
+            response->dns_ticket_          = 0;
+            response->timing_.dns_resolved = HttpTiming::Clock::now();
+            if ( !error.empty() ) {
+                response->failure_ = RequestError::Dns;
+                Fail( response, error );
+                return;
+            }
+            auto *loop = response->loop_;
+            // another request may have opened a connection while this one was resolving
+            auto *connection = loop->Pool().Acquire( key );
+            if ( connection == nullptr ) {
+                connection = CreateConnection( loop->Base(), address, *response->origin_, response->ssl_config_ );
+                if ( connection == nullptr ) {
+                    Fail( response, "failed to create connection: " + SSLConfig::SSLErrorString() );
+                    return;
+                }
+                loop->Pool().Add( key, connection );
+                response->connect_started_ = HttpResponse::Clock::now();
+                HttpMetrics::Host::Add( response->metrics_->pool_misses );
+            }
+            else {
+                response->timing_.connection_reused = true;
+                HttpMetrics::Host::Add( response->metrics_->pool_hits );
+            }
+            MakeRequest( response, connection );
+        } );
+}
+
+void HttpClient::MakeRequest( HttpResponse *response, evhttp_connection *connection ) {
+    auto &request   = *response->origin_;
+    auto &pool      = response->loop_->Pool();
+    response->connection_ = connection;
     // request
-    raii_evhttp_request req( request.ToEvRequest( OnRequestDone, response.get() ) );
+    raii_evhttp_request req( request.ToEvRequest( OnRequestDone, response ) );
     if ( !req ) {
-        return nullptr;
+        pool.Release( std::exchange( response->connection_, nullptr ), true );
+        Fail( response, "failed to create request" );
+        return;
     }
-    evhttp_request_own( req.get() );
-    evhttp_request_set_error_cb( req.get(), []( evhttp_request_error error, void * ) {
-        std::cerr << "http request error: " << error << std::endl;
+    if ( response->decompress_ && !request.GetHeader().Contains( "Accept-Encoding" ) ) {
+        evhttp_add_header( evhttp_request_get_output_headers( req.get() ), "Accept-Encoding",
+                           Inflater::AcceptEncoding() );
+    }
+    // the body is inflated as it arrives, once the header callback has seen Content-Encoding
+    auto &timeouts = response->timeouts_;
+    if ( request.body_callback_ || request.body_stream_ || timeouts.idle_read_ms > 0 || response->decompress_ ) {
+        evhttp_request_set_chunked_cb( req.get(), OnRequestChunk );
+    }
+    // also takes the time of the first byte
+    evhttp_request_set_header_cb( req.get(), OnRequestHeader );
+    evhttp_request_set_error_cb( req.get(), []( evhttp_request_error error, void *arg ) {
+        auto *resp = reinterpret_cast<HttpResponse *>( arg );
+        switch ( error ) {
+            case EVREQ_HTTP_TIMEOUT:
+                resp->failure_ = RequestError::Timeout;
+                break;
+            case EVREQ_HTTP_INVALID_HEADER:
+            case EVREQ_HTTP_DATA_TOO_LONG:
+                resp->failure_ = RequestError::Protocol;
+                break;
+            case EVREQ_HTTP_REQUEST_CANCEL:
+                resp->failure_ = RequestError::Cancelled;
+                break;
+            default:
+                resp->failure_ = RequestError::Connection;
+                break;
+        }
     } );
-    if ( evhttp_make_request( connection.get(), req.get(), ToEvType( request.GetMethod() ),
-                              request.GetUri().c_str() ) != 0 ) {
-        return nullptr;
+    size_t body_size = evbuffer_get_length( evhttp_request_get_output_buffer( req.get() ) );
+    if ( evhttp_make_request( connection, req.get(), ToEvType( request.GetMethod() ), request.GetUri().c_str() ) !=
+         0 ) {
+        pool.Release( std::exchange( response->connection_, nullptr ), false );
+        Fail( response, "failed to make request" );
+        return;
     }
     // all success
-    response->connection_ = connection.release();
-    response->request_    = req.release();
-    return response;
+    HttpMetrics::Host::Add( response->metrics_->bytes_out, body_size );
+    response->request_ = req.release();
+    // timing of the write and, on a new connection, of the connect and handshake
+    auto *bufev         = evhttp_connection_get_bufferevent( connection );
+    response->write_cb_ = evbuffer_add_cb( bufferevent_get_output( bufev ), OnRequestWritten, response );
+#ifdef BUILD_WITH_SSL
+    // only the request that opened the connection sees its handshake
+    auto *ssl = bufferevent_openssl_get_ssl( bufev );
+    if ( ssl != nullptr && !response->timing_.connection_reused ) {
+        SSL_set_ex_data( ssl, TimingIndex(), response );
+    }
+#endif
+    ArmTimer( response );
+}
+
+void HttpClient::Fail( HttpResponse *response, const std::string &error ) {
+    response->loop_->RemoveLoad();
+    response->error_ = error;
+    response->Finish();
+}
+
+evhttp_connection *HttpClient::CreateConnection( event_base *base, const std::string &address,
+                                                 const HttpRequest &request, SSLConfig *ssl_config ) {
+    // address is numeric, so evhttp does not resolve the host again
+#ifdef BUILD_WITH_SSL
+    if ( ssl_config != nullptr ) {
+        // buffer
+        bufferevent *bufev = nullptr;
+        if ( request.GetScheme() != "https" ) {
+            bufev = bufferevent_socket_new( base, -1, BEV_OPT_CLOSE_ON_FREE );
+        }
+        else {
+            auto *ssl = ssl_config->CreateSSL( request.GetHost(), request.GetPort() );
+            if ( ssl == nullptr ) {
+                return nullptr;
+            }
+            SSL_set_info_callback( ssl, OnSSLInfo );
+            bufev = bufferevent_openssl_socket_new( base, -1, ssl, BUFFEREVENT_SSL_CONNECTING,
+                                                    BEV_OPT_CLOSE_ON_FREE | BEV_OPT_DEFER_CALLBACKS );
+        }
+        if ( !bufev ) {
+            return nullptr;
+        }
+        bufferevent_openssl_set_allow_dirty_shutdown( bufev, 1 );
+        return evhttp_connection_base_bufferevent_new( base, nullptr, bufev, address.c_str(), request.GetPort() );
+    }
 #else
     (void)ssl_config;
-    return Send( request );
 #endif
+    return evhttp_connection_base_new( base, nullptr, address.c_str(), request.GetPort() );
 }
 
-void HttpClient::StartEventLoop() {
-    if ( running_ && base_ ) {
-        StopEventLoop();
+void HttpClient::Cancel( HttpResponse *response ) {
+    if ( response->loop_ == nullptr ) {
+        // a fresh cache hit, finished without a loop
+        return;
     }
-    evthread_use_pthreads();
-    base_ = event_base_new();
-    if ( !base_ ) {
-        throw std::runtime_error( "Failed to create event base" );
+    auto cancel = [response]() {
+        response->cancelled_ = true;
+        Abort( response, "request cancelled" );
+    };
+    if ( response->loop_->IsInLoopThread() ) {
+        cancel();
+        return;
     }
-    running_ = true;
-    worker_  = std::thread( [this]() {
-        std::chrono::milliseconds ms( 300 );
-        while ( running_ ) {
-            event_base_dispatch( base_ );
-            std::this_thread::sleep_for( ms );
+    // wait for the cancel to have run, the response may complete before it and be freed by its owner right after
+    std::promise<void> cancelled;
+    response->loop_->RunInLoop( [&cancel, &cancelled]() {
+        cancel();
+        cancelled.set_value();
+    } );
+    cancelled.get_future().wait();
+}
+
+void HttpClient::Abort( HttpResponse *response, const std::string &error ) {
+    if ( response->retry_ && response->attempt_count_ > 0 ) {
+        if ( response->retry_timer_ ) {
+            response->loop_->Timers().Cancel( std::exchange( response->retry_timer_, 0 ) );
         }
+        for ( auto *attempt : std::exchange( response->attempts_, {} ) ) {
+            attempt->callback_ = []( HttpResponse::Ptr ) {};
+            Abort( attempt, error );
+        }
+        Fail( response, error );
+    }
+    else if ( response->dns_ticket_ ) {
+        response->loop_->Dns().Cancel( std::exchange( response->dns_ticket_, 0 ) );
+        Fail( response, error );
+    }
+    else if ( response->request_ ) {
+        // evhttp frees the cancelled request without running its done callback, and resets its connection
+        evhttp_cancel_request( response->request_ );
+        response->error_ = error;
+        OnRequestDone( nullptr, response );
+    }
+    else if ( response->coalescer_ && response->coalescer_->Leave( response->coalesce_key_, response ) ) {
+        // waiting for a request sent for it and others, which goes on for the others
+        response->error_ = error;
+        response->Finish();
+    }
+    else if ( response->limiter_ && response->limiter_->Remove( response->limit_key_, response ) ) {
+        // still waiting for a slot, one handed over meanwhile is dispatched and failed there
+        Fail( response, error );
+    }
+}
+
+void HttpClient::ArmTimer( HttpResponse *response ) {
+    using std::chrono::milliseconds;
+    auto &timeouts = response->timeouts_;
+    auto  deadline = HttpResponse::Clock::time_point::max();
+    auto  consider = [&deadline]( HttpResponse::Clock::time_point from, int ms ) {
+        if ( ms > 0 && from != HttpResponse::Clock::time_point() ) {
+            deadline = std::min( deadline, from + milliseconds( ms ) );
+        }
+    };
+    consider( response->started_, timeouts.total_ms );
+    consider( response->connect_started_, timeouts.connect_ms );
+    if ( response->last_read_ == HttpResponse::Clock::time_point() ) {
+        consider( response->timing_.sent, timeouts.header_ms );
+    }
+    consider( IdleSince( response ), timeouts.idle_read_ms );
+
+    auto &timers = response->loop_->Timers();
+    if ( response->timer_ ) {
+        timers.Cancel( std::exchange( response->timer_, 0 ) );
+    }
+    if ( deadline == HttpResponse::Clock::time_point::max() ) {
+        return;
+    }
+    auto delay = std::chrono::duration_cast<milliseconds>( deadline - HttpResponse::Clock::now() ).count() + 1;
+    response->timer_ = timers.Add( static_cast<int>( std::max<int64_t>( delay, 0 ) ), [response]() {
+        response->timer_ = 0;
+        CheckDeadlines( response );
     } );
 }
 
-void HttpClient::StopEventLoop() {
-    running_ = false;
-    event_base_loopexit( base_, nullptr );
-    if ( worker_.joinable() ) {
-        worker_.join();
+void HttpClient::CheckDeadlines( HttpResponse *response ) {
+    using std::chrono::milliseconds;
+    auto &timeouts = response->timeouts_;
+    auto  now      = HttpResponse::Clock::now();
+    auto  expired  = [now]( HttpResponse::Clock::time_point from, int ms ) {
+        return ms > 0 && from != HttpResponse::Clock::time_point() && now >= from + milliseconds( ms );
+    };
+    std::string error;
+    if ( expired( response->started_, timeouts.total_ms ) ) {
+        error = "timeout: request not done within " + std::to_string( timeouts.total_ms ) + " ms";
+    }
+    else if ( expired( response->connect_started_, timeouts.connect_ms ) ) {
+        if ( response->connection_ && IsConnected( response->connection_ ) ) {
+            response->connect_started_ = HttpResponse::Clock::time_point();
+        }
+        else {
+            error = "timeout: not connected within " + std::to_string( timeouts.connect_ms ) + " ms";
+        }
+    }
+    else if ( response->last_read_ == HttpResponse::Clock::time_point() &&
+              expired( response->timing_.sent, timeouts.header_ms ) ) {
+        error = "timeout: no response headers within " + std::to_string( timeouts.header_ms ) + " ms";
+    }
+    else if ( expired( IdleSince( response ), timeouts.idle_read_ms ) ) {
+        error = "timeout: nothing read for " + std::to_string( timeouts.idle_read_ms ) + " ms";
+    }
+    if ( error.empty() ) {
+        ArmTimer( response );
+        return;
+    }
+    response->timeout_ = true;
+    Abort( response, error );
+}
+
+HttpResponse::Clock::time_point HttpClient::IdleSince( const HttpResponse *response ) {
+    auto *stream = response->origin_ ? response->origin_->body_stream_.get() : nullptr;
+    if ( stream == nullptr || response->last_read_ == HttpResponse::Clock::time_point() ) {
+        return response->last_read_;
+    }
+    // the consumer is slow, not the server, the deadline starts over once reading resumes
+    return stream->reading_paused_ ? HttpResponse::Clock::now() : std::max( response->last_read_, stream->resumed_ );
+}
+
+void HttpClient::StartAttempt( HttpResponse *response ) {
+    auto *attempt        = new HttpResponse();
+    attempt->callback_   = [response]( HttpResponse::Ptr done ) { OnAttemptDone( response, std::move( done ) ); };
+    attempt->loop_       = response->loop_;
+    attempt->origin_     = std::make_unique<HttpRequest>( *response->origin_ );
+    attempt->ssl_config_ = response->ssl_config_;
+    attempt->timeouts_   = response->timeouts_;
+    attempt->decompress_ = response->decompress_;
+    attempt->parent_     = response;
+    // the total deadline covers all attempts and is kept by response
+    attempt->timeouts_.total_ms = 0;
+    response->attempts_.push_back( attempt );
+    ++response->attempt_count_;
+    response->loop_->AddLoad();
+    if ( response->retry_->hedge_after_ms > 0 && response->attempt_count_ == 1 ) {
+        response->retry_timer_ = response->loop_->Timers().Add( response->retry_->hedge_after_ms, [response]() {
+            response->retry_timer_ = 0;
+            if ( response->budget_->Withdraw() ) {
+                StartAttempt( response );
+            }
+        } );
+    }
+    // last, the attempt may finish response before returning
+    Dispatch( attempt );
+}
+
+void HttpClient::OnAttemptDone( HttpResponse *response, HttpResponse::Ptr attempt ) {
+    auto &attempts = response->attempts_;
+    attempts.erase( std::remove( attempts.begin(), attempts.end(), attempt.get() ), attempts.end() );
+    auto &policy = *response->retry_;
+    bool  retry  = attempt->status_code_ <= 0 ||
+                  std::find( policy.retry_status.begin(), policy.retry_status.end(), attempt->status_code_ ) !=
+                      policy.retry_status.end();
+    if ( retry && !attempts.empty() ) {
+        // the other copy of a hedged request is still running
+        return;
+    }
+    if ( response->retry_timer_ ) {
+        response->loop_->Timers().Cancel( std::exchange( response->retry_timer_, 0 ) );
+    }
+    response->http_version_   = std::move( attempt->http_version_ );
+    response->status_code_    = attempt->status_code_;
+    response->status_phrase_  = std::move( attempt->status_phrase_ );
+    response->header_         = std::move( attempt->header_ );
+    response->body_           = std::move( attempt->body_ );
+    response->error_          = std::move( attempt->error_ );
+    response->session_reused_ = attempt->session_reused_;
+    response->timeout_        = attempt->timeout_;
+    response->failure_        = attempt->status_code_ <= 0 ? std::optional( attempt->Failure() ) : std::nullopt;
+    attempt->timing_.queued   = response->timing_.queued;
+    response->timing_         = attempt->timing_;
+    if ( !retry ) {
+        // first answer wins, a hedged copy still running is cancelled
+        for ( auto *other : std::exchange( attempts, {} ) ) {
+            other->callback_ = []( HttpResponse::Ptr ) {};
+            Abort( other, "request cancelled" );
+        }
+    }
+    else if ( response->attempt_count_ < policy.max_attempts && response->budget_->Withdraw() ) {
+        // full jitter: uniform in [0, min(max, base * 2^(n - 1))]
+        static thread_local std::mt19937 random( std::random_device{}() );
+        int64_t backoff = std::max( policy.base_backoff_ms, 0 );
+        for ( int i = 1; i < response->attempt_count_ && backoff < policy.max_backoff_ms; ++i ) {
+            backoff *= 2;
+        }
+        backoff = std::min<int64_t>( backoff, std::max( policy.max_backoff_ms, 0 ) );
+        int delay = std::uniform_int_distribution<int>( 0, static_cast<int>( backoff ) )( random );
+        response->retry_timer_ = response->loop_->Timers().Add( delay, [response]() {
+            response->retry_timer_ = 0;
+            StartAttempt( response );
+        } );
+        return;
+    }
+    response->loop_->RemoveLoad();
+    response->Finish();
+}
+
+EventLoop *HttpClient::SelectLoop( const HttpRequest &request ) const {
+    if ( loops_.size() == 1 ) {
+        return loops_.front().get();
+    }
+    // identical requests must meet on one loop to be coalesced
+    if ( options_.loop_balance == LoopBalance::LeastLoaded && !coalescer_ ) {
+        EventLoop *selected = loops_.front().get();
+        for ( auto &loop : loops_ ) {
+            if ( loop->Load() < selected->Load() ) {
+                selected = loop.get();
+            }
+        }
+        return selected;
     }
-    event_base_free( base_ );
-    base_ = nullptr;
+    // same host always lands on the same loop, so its keep-alive connections are shared
+    size_t hash = std::hash<std::string>()( request.GetHost() ) ^ request.GetPort();
+    return loops_[hash % loops_.size()].get();
 }
@@ -1,21 +1,104 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <future>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#ifdef BUILD_WITH_COROUTINE
+    #include <coroutine>
+#endif
+
+#include "BodyStream.h"
+#include "ConnectionPool.h"
+#include "EventLoop.h"
+#include "HttpHeaders.h"
+#include "HttpMetrics.h"
+#include "Inflater.h"
+#include "RequestCoalescer.h"
+#include "RequestLimiter.h"
+#include "ResponseCache.h"
+#include "ResponseBody.h"
+#include "RetryPolicy.h"
 #include "SSLConfig.h"
 
+struct evbuffer;
+struct evbuffer_cb_entry;
+struct evbuffer_cb_info;
 struct evhttp_request;
 struct evhttp_connection;
 struct event_base;
 
 class HttpClient;
 
+enum class LoopBalance
+{
+    HostAffinity,  // requests to the same host always run on the same loop
+    LeastLoaded,   // requests run on the loop with the fewest unfinished requests
+};
+
+// request deadlines in milliseconds, 0 disables one
+struct HttpTimeouts {
+    int connect_ms   = 0;  // opening a new connection, TCP connect only
+    int header_ms    = 0;  // from the request being written until the response headers are in
+    int idle_read_ms = 0;  // without reading from the response once its headers are in
+    int total_ms     = 0;  // whole request, including resolving and waiting for a connection, not a limiter slot
+};
+
+/**
+ * @brief Where the time of a request went, see HttpResponse::Timing()
+ * Points are taken from the monotonic clock as the request goes along, a point that did not happen (e.g. resolving
+ * and connecting for a request sent on a pooled connection) stays at time_point(). For a request queued behind another
+ * on its connection, sent may be taken from the write of the one before it. A coalesced response has the points of the
+ * request it waited for, those before its own Send call cleared.
+ */
+struct HttpTiming {
+    using Clock    = std::chrono::steady_clock;
+    using Duration = std::chrono::microseconds;
+
+    Clock::time_point queued;        // Send called
+    Clock::time_point started;       // picked up by the event loop, after waiting for a slot with limits set
+    Clock::time_point dns_resolved;  // new connections only
+    Clock::time_point connected;     // TCP connected, new connections only
+    Clock::time_point tls_done;      // handshake done, new https connections only
+    Clock::time_point sent;          // request written to the connection
+    Clock::time_point first_byte;    // response headers in
+    Clock::time_point completed;
+    bool              connection_reused = false;  // sent on a pooled keep-alive connection
+    bool              session_reused    = false;  // TLS handshake resumed a cached session
+
+    // zero when either point did not happen
+    static Duration Between( Clock::time_point from, Clock::time_point to );
+    Duration        Queue() const;     // queued -> started, mostly the wait for a limiter slot
+    Duration        Dns() const;       // started -> dns_resolved
+    Duration        Connect() const;   // dns_resolved -> connected
+    Duration        Tls() const;       // connected -> tls_done
+    Duration        Wait() const;      // sent -> first_byte
+    Duration        Download() const;  // first_byte -> completed
+    Duration        Total() const;     // queued -> completed
+};
+
+struct HttpClientOptions {
+    ConnectionPoolOptions pool;         // per event loop
+    DnsOptions            dns;          // per event loop
+    HttpTimeouts          timeouts;     // for requests without their own
+    RetryPolicy           retry;        // for requests without their own, the budget is shared by all requests
+    LimitOptions          limits;       // for all event loops, retries and hedges of a request share its slot
+    CacheOptions          cache;        // GET responses, for all event loops
+    CoalesceOptions       coalesce;     // identical GETs in flight, for all event loops
+    bool                  decompress        = false;  // ask for gzip / deflate and inflate the body, needs zlib
+    size_t                compress_body_min = 0;  // gzip SetBody bodies of at least this size, 0 disables, needs zlib
+    size_t                event_loops       = 1;  // ignored when the client is given an event base
+    LoopBalance           loop_balance      = LoopBalance::HostAffinity;
+};
+
 class HttpRequest final {
 public:
     enum Method
@@ -23,26 +106,42 @@ public:
         POST,
         GET,
     };
+    // gets each response body chunk on the event loop thread as it arrives
+    using BodyCallback = std::function<void( std::string_view chunk )>;
+    // fills buffer with at most size bytes of request body and returns the count, 0 at the end
+    using BodyGenerator = std::function<size_t( char *buffer, size_t size )>;
 
     HttpRequest &SetMethod( Method method );
     HttpRequest &SetFullUrl( const std::string &url );               // e.g. http://www.example.com/path?query=value
     HttpRequest &SetScheme( const std::string &scheme );             // e.g. http, https
     HttpRequest &SetHost( const std::string &host, uint16_t port );  // e.g. host: www.example.com port: 80
     HttpRequest &SetPath( const std::string &path );                 // e.g. "/", "/path"
-    HttpRequest &SetHeader( const std::string &key, const std::string &value );
-    HttpRequest &SetHeader( const std::map<std::string, std::string> &header );
+    HttpRequest &SetHeader( const std::string &key, const std::string &value );  // replaces fields named key
+    HttpRequest &SetHeader( const HttpHeaders &header );                         // replaces all fields
+    HttpRequest &AddHeader( const std::string &key, const std::string &value );  // keeps fields named key
     HttpRequest &SetQuery( const std::string &key, const std::string &value );
     HttpRequest &SetQuery( const std::map<std::string, std::string> &query );
     HttpRequest &SetBody( const std::string &body );
     HttpRequest &SetBody( std::string &&body );
+    // request body sources below are sent without an extra copy, setting any body replaces the previous one
+    HttpRequest &SetBody( std::shared_ptr<const std::string> body );  // kept alive until written to the connection
+    HttpRequest &SetBodyFile( const std::string &path, int64_t offset = 0, int64_t length = -1 );  // -1: to the end
+    HttpRequest &SetBodyGenerator( BodyGenerator generator );  // pulled on the event loop thread when sent
+    // stream the response body instead of collecting it in HttpResponse::Body(), the callback wins if both are set
+    HttpRequest &SetBodyCallback( BodyCallback callback );
+    HttpRequest &SetBodyStream( BodyStream::Ptr stream );  // one request per stream
+    HttpRequest &SetTimeouts( const HttpTimeouts &timeouts );  // instead of HttpClientOptions::timeouts
+    HttpRequest &SetRetryPolicy( const RetryPolicy &policy );  // instead of HttpClientOptions::retry, GET only
+    HttpRequest &SetDecompress( bool decompress );             // instead of HttpClientOptions::decompress
+    HttpRequest &SetCompressBody( size_t min_size );           // instead of HttpClientOptions::compress_body_min
 
     Method                                    GetMethod() const;
     const std::string                        &GetScheme() const;
     const std::string                        &GetHost() const;
     uint16_t                                  GetPort() const;
     const std::string                        &GetPath() const;  // Should not be empty, at least "/" on request
-    const std::map<std::string, std::string> &GetHeader() const;
-    std::string                               GetHeader( const std::string &key ) const;
+    const HttpHeaders                        &GetHeader() const;
+    std::string                               GetHeader( const std::string &key ) const;  // case-insensitive
     const std::map<std::string, std::string> &GetQuery() const;
     std::string                               GetQuery( const std::string &key ) const;
     std::string                               GetUri() const;
@@ -53,24 +152,80 @@ public:
 
 private:
     friend class HttpClient;
+    friend class HttpResponse;
+    friend class PreparedRequest;
+    friend void OnRequestChunk( evhttp_request *, void * );
+
+    // invariant parts of the requests instantiated from one PreparedRequest
+    struct SharedQuery {
+        std::map<std::string, std::string> query;
+        std::string                        uri;
+    };
+
     using DoneCallback = void ( * )( evhttp_request *, void * );
     [[nodiscard( "must be free by evhttp_request_free()" )]] evhttp_request *ToEvRequest( DoneCallback &&cb,
                                                                                           void          *cb_arg ) const;
+    std::string MakeHostHeader() const;
+    // copy shared parts before changing them
+    void DetachHeader();
+    void DetachQuery();
+    // gzip the body when it reaches compress_body_min_, which is then cleared so copies do not compress it again
+    void CompressBody();
+    void ClearBody();
+    bool AddBody( evbuffer *buffer ) const;
+    bool AddBodyFile( evbuffer *buffer ) const;
 
     Method                             method_ = Method::POST;
     std::string                        scheme_;
     std::string                        host_;
     uint16_t                           port_ = 80;
     std::string                        path_;
-    std::map<std::string, std::string> header_;
+    HttpHeaders                        header_;
     std::map<std::string, std::string> query_;
     std::string                        body_;
+    std::shared_ptr<const std::string> shared_body_;
+    std::string                        body_file_;
+    int64_t                            body_file_offset_ = 0;
+    int64_t                            body_file_length_ = -1;
+    BodyGenerator                      body_generator_;
+    BodyCallback                       body_callback_;
+    BodyStream::Ptr                    body_stream_;
+    std::optional<HttpTimeouts>        timeouts_;
+    std::optional<RetryPolicy>         retry_;
+    std::optional<bool>                decompress_;
+    std::optional<size_t>              compress_body_min_;
+    // set on requests from PreparedRequest::Instantiate(), used instead of header_ / query_ until changed
+    std::shared_ptr<const HttpHeaders> shared_header_;
+    std::shared_ptr<const SharedQuery> shared_query_;
+    std::shared_ptr<const std::string> host_header_;
+};
+
+/**
+ * @brief Request template for sending the same request many times
+ * The headers, the Host header and the URI with its query are built once and shared by every request from
+ * Instantiate(), so an instance neither copies nor rebuilds them. Sending still adds each header to the evhttp request.
+ * Setting the body on an instance keeps everything shared, changing headers or the query copies that part into the
+ * instance first.
+ */
+class PreparedRequest final {
+public:
+    explicit PreparedRequest( const HttpRequest &request );
+
+    HttpRequest Instantiate() const;
+
+private:
+    HttpRequest request_;
 };
 
 class HttpResponse final {
 public:
     using Ptr = std::unique_ptr<HttpResponse>;
+    // completion callback of HttpClient::Send, the response is done when called
+    using Callback = std::function<void( Ptr )>;
+    // runs the completion callback, e.g. posts it to a thread pool
+    using Executor = std::function<void( std::function<void()> )>;
 
+    // for a response that is done, a request in flight is referred to by the address of its response
     HttpResponse( HttpResponse &&other );
     HttpResponse &operator=( HttpResponse &&other );
     HttpResponse( const HttpResponse & )            = delete;
@@ -83,11 +238,18 @@ public:
 
     int                                       StatusCode() const;
     const std::string                        &StatusPhrase() const;
-    const std::string                        &Body() const;
-    const std::map<std::string, std::string> &Header() const;
-    std::string                               Header( const std::string &key ) const;
+    const std::string                        &Body() const;        // flattened on first call
+    const ResponseBody                       &BodyBuffer() const;  // body without copying, see ResponseBody
+    const HttpHeaders                        &Header() const;
+    std::string                               Header( const std::string &key ) const;  // case-insensitive, first field
     bool                                      IsSuccess() const;
     const std::string                        &ErrorString() const;
+    bool                                      IsSessionReused() const;  // TLS handshake resumed a cached session
+    bool                                      IsTimeout() const;        // failed because a deadline passed
+    bool                                      IsFromCache() const;      // from the response cache, fresh or after a 304
+    bool                                      IsCoalesced() const;      // answered by an identical request in flight
+    // for a retried request, the points of the attempt that counted, queued is still when Send was called
+    const HttpTiming                         &Timing() const;
 
 
     std::string ToString() const;
@@ -96,32 +258,169 @@ private:
     explicit HttpResponse();
     friend class HttpClient;
 
-    std::atomic_bool   is_done_ = false;
-    std::promise<bool> promise_;
-    std::future<bool>  future_;
+    std::atomic_bool                  is_done_ = false;
+    std::optional<std::promise<bool>> promise_;  // only for responses returned by Send, not for callbacks
+    std::future<bool>                 future_;
+    Callback                          callback_;
+    Executor                          executor_;
 
     std::string                        http_version_;
     int                                status_code_ = -1;
     std::string                        status_phrase_;
-    std::map<std::string, std::string> header_;
-    std::string                        body_;
+    HttpHeaders                        header_;
+    ResponseBody                       body_;
     std::string                        error_;
+    bool                               session_reused_ = false;
+    bool                               timeout_        = false;
+    HttpTiming                         timing_;
 
 private:
     friend void OnRequestDone( evhttp_request *, void * );
+    friend void OnRequestChunk( evhttp_request *, void * );
+    friend int  OnRequestHeader( evhttp_request *, void * );
+    friend void OnRequestWritten( evbuffer *, const evbuffer_cb_info *, void * );
+    friend void OnSSLInfo( const SSL *, int, int );
+
+    using Clock = std::chrono::steady_clock;
+
+    void         Finish();
+    RequestError Failure() const;  // for a response without a status
+
+    EventLoop                   *loop_ = nullptr;
+    std::unique_ptr<HttpRequest> origin_;  // kept until the request is done
+    SSLConfig                   *ssl_config_ = nullptr;
+    // loop thread only
+    bool               cancelled_  = false;
+    uint64_t           dns_ticket_ = 0;
+    evhttp_connection *connection_ = nullptr;  // borrowed from the loop's pool until the request is done
+    evhttp_request    *request_    = nullptr;  // freed by evhttp when done, loop thread only
+    evbuffer_cb_entry *write_cb_   = nullptr;  // on the connection's output while in flight, sets timing_.sent
+    HttpMetrics::Host          *metrics_ = nullptr;  // of the host in the loop's metrics, set once dispatched
+    HttpResponse               *parent_  = nullptr;  // for an attempt, the response it was sent for
+    std::optional<RequestError> failure_;            // set where the cause is known, see Failure()
+    // concurrency limits, only with HttpClientOptions::limits set
+    RequestLimiter *limiter_    = nullptr;
+    std::string     limit_key_;
+    bool            holds_slot_ = false;  // released when done, the next queued request starts in its place
+    bool            rejected_   = false;  // failed by Dispatch
+    // response cache, only with HttpClientOptions::cache set
+    ResponseCache      *cache_ = nullptr;  // the response is stored, or the key invalidated, when done
+    std::string         cache_key_;
+    CachedResponse::Ptr revalidating_;  // stale entry, the request carries its validators
+    bool                from_cache_ = false;
+    // single-flight, only with HttpClientOptions::coalesce set. A coalesced request is sent by a response of its own
+    // for all callers, which wait for it, see OnFlightDone()
+    RequestCoalescer *coalescer_ = nullptr;  // waiting on the request in flight for coalesce_key_
+    std::string       coalesce_key_;
+    bool              coalesced_ = false;  // answered with the response of a request sent for another caller
+    bool              flight_    = false;  // sends the request for the callers waiting, which are counted instead
+    // deadlines, loop thread only
+    HttpTimeouts      timeouts_;
+    uint64_t          timer_ = 0;  // in the loop's timer wheel, for the nearest deadline
+    Clock::time_point started_;
+    Clock::time_point connect_started_;  // only when this request opened its connection
+    Clock::time_point last_read_;  // set once the response headers are in
+    // retries and hedging, loop thread only. With a policy set, the request is sent by attempts of their own and
+    // this response takes the result of the one that counts
+    const RetryPolicy          *retry_         = nullptr;
+    RetryBudget                *budget_        = nullptr;
+    std::vector<HttpResponse *> attempts_;  // in flight
+    int                         attempt_count_ = 0;
+    uint64_t                    retry_timer_   = 0;  // backoff or hedge delay
+    // Content-Encoding, loop thread only. The body callback, stream and Body() get inflated data
+    bool                      decompress_   = false;
+    bool                      decode_error_ = false;
+    std::unique_ptr<Inflater> inflater_;  // set when the response headers name a supported encoding
+};
+
+/**
+ * @brief Single completion handle for the requests of HttpClient::SendBatch
+ * Destroying an unfinished batch cancels its unfinished requests.
+ */
+class BatchResponse final {
+public:
+    using Ptr = std::unique_ptr<BatchResponse>;
+
+    BatchResponse( const BatchResponse & )            = delete;
+    BatchResponse &operator=( const BatchResponse & ) = delete;
+    ~BatchResponse();
+
+    bool IsDone();
+    void WaitForDone();
+    bool WaitFor( int timeout_ms );
+
+    size_t Size() const;
+    // response of the request at index in the batch, only valid once the batch is done
+    HttpResponse &At( size_t index );
+
+private:
+    friend class HttpClient;
+    explicit BatchResponse( size_t size );
+
+    // called on the loop thread as each request completes
+    void Complete( size_t index, HttpResponse::Ptr response );
+
+    std::atomic_bool               is_done_ = false;
+    std::promise<void>             promise_;
+    std::future<void>              future_;
+    std::atomic<size_t>            remaining_;
+    std::vector<HttpResponse::Ptr> responses_;
+    std::vector<HttpResponse *>    requests_;  // the same responses while in flight, for cancelling
+};
+
+#ifdef BUILD_WITH_COROUTINE
+/**
+ * @brief Awaitable returned by HttpClient::AsyncSend
+ * The request is started when awaited, the coroutine is resumed from the event loop thread when the response is done
+ * (or through the executor if one is given), co_await gives the finished HttpResponse::Ptr. A response done before
+ * Send returns, such as a fresh cached one, does not suspend the coroutine at all.
+ */
+class SendAwaiter final {
+public:
+    bool              await_ready() const noexcept { return false; }
+    bool              await_suspend( std::coroutine_handle<> handle );
+    HttpResponse::Ptr await_resume() { return std::move( response_ ); }
+
+private:
+    friend class HttpClient;
+    SendAwaiter( HttpClient &client, const HttpRequest &request, SSLConfig *ssl_config,
+                 HttpResponse::Executor executor );
 
-    evhttp_connection *connection_ = nullptr;
-    evhttp_request    *request_    = nullptr;
+    HttpClient            *client_ = nullptr;
+    HttpRequest            request_;
+    SSLConfig             *ssl_config_ = nullptr;
+    HttpResponse::Executor executor_;
+    HttpResponse::Ptr      response_;
+    std::atomic_bool       done_ = false;  // set by whichever comes second resumes, the callback or await_suspend
 };
+#endif
 
 class HttpClient final {
 public:
     explicit HttpClient();
+    /**
+     * @brief Client running options.event_loops event loops, each on its own thread
+     *
+     * @param options
+     */
+    explicit HttpClient( const HttpClientOptions &options );
+    /**
+     * @brief Client on an event_base the caller drives
+     * Requests are started from the thread driving the base, it is known from the first turn of the loop on.
+     *
+     * @param base
+     */
     HttpClient( event_base *base );
+    HttpClient( event_base *base, const HttpClientOptions &options );
     ~HttpClient();
 
     /**
      * @brief HTTP request
+     * The request is started on the event loop thread, reusing an idle keep-alive connection to the same host when
+     * the pool has one. Failures are reported through the response. With HttpClientOptions::cache set, a fresh cached
+     * response is returned already done, without involving the event loop. With HttpClientOptions::coalesce set, a GET
+     * identical to one in flight is not sent again but waits for its response, under the timeouts and retry policy of
+     * the request that was sent.
      *
      * @param request
      * @return HttpResponse::Ptr
@@ -138,11 +437,128 @@ public:
      */
     [[nodiscard]] HttpResponse::Ptr Send( const HttpRequest &request, SSLConfig &ssl_config );
 
+    /**
+     * @brief HTTP request completed through a callback instead of a future
+     * callback gets the finished response on the loop thread, or through executor if one is given. No promise or
+     * future is created for the request. The callback must not block the loop, and is not called for requests still
+     * unfinished when the client is destroyed. A fresh cached response is passed to callback before Send returns, on
+     * the calling thread unless executor is given.
+     *
+     * @param request
+     * @param callback
+     * @param executor
+     */
+    void Send( const HttpRequest &request, HttpResponse::Callback callback, HttpResponse::Executor executor = nullptr );
+
+    /**
+     * @brief HTTPS request completed through a callback instead of a future
+     * If build without SSL support, this function is the same as Send(const HttpRequest &, HttpResponse::Callback,
+     * HttpResponse::Executor)
+     *
+     * @param request
+     * @param ssl_config
+     * @param callback
+     * @param executor
+     */
+    void Send( const HttpRequest &request, SSLConfig &ssl_config, HttpResponse::Callback callback,
+               HttpResponse::Executor executor = nullptr );
+
+    /**
+     * @brief Send many requests with one completion handle
+     * Requests to the same (scheme, host, port) are handed to one event loop in a single task and share that host's
+     * pooled keep-alive connections, requests beyond max_per_host connections wait on an open connection instead of
+     * opening new ones.
+     *
+     * @param requests
+     * @return BatchResponse::Ptr responses in the order of requests
+     */
+    [[nodiscard]] BatchResponse::Ptr SendBatch( const std::vector<HttpRequest> &requests );
+
+    /**
+     * @brief HTTPS batch, see SendBatch(const std::vector<HttpRequest> &)
+     * If build without SSL support, this function is the same as SendBatch(const std::vector<HttpRequest> &)
+     *
+     * @param requests
+     * @param ssl_config
+     * @return BatchResponse::Ptr
+     */
+    [[nodiscard]] BatchResponse::Ptr SendBatch( const std::vector<HttpRequest> &requests, SSLConfig &ssl_config );
+
+    /**
+     * @brief Counters and latency histograms of all requests so far, per host
+     * Each event loop records its own requests without locking, this adds them up. Fresh cached responses are not
+     * included, see HttpMetrics. See MetricsSnapshot::ToPrometheus() and MetricsSnapshot::ToJson() for exporting.
+     *
+     * @return MetricsSnapshot
+     */
+    MetricsSnapshot Metrics() const;
+
+#ifdef BUILD_WITH_COROUTINE
+    /**
+     * @brief HTTP request for coroutines, e.g. auto response = co_await client.AsyncSend( request );
+     * No thread blocks while waiting. Without executor the coroutine continues on the event loop thread, so it must
+     * not block there.
+     *
+     * @param request
+     * @param executor
+     * @return SendAwaiter
+     */
+    [[nodiscard]] SendAwaiter AsyncSend( const HttpRequest &request, HttpResponse::Executor executor = nullptr );
+
+    /**
+     * @brief HTTPS request for coroutines, see AsyncSend(const HttpRequest &, HttpResponse::Executor)
+     *
+     * @param request
+     * @param ssl_config
+     * @param executor
+     * @return SendAwaiter
+     */
+    [[nodiscard]] SendAwaiter AsyncSend( const HttpRequest &request, SSLConfig &ssl_config,
+                                         HttpResponse::Executor executor = nullptr );
+#endif
+
 private:
-    void StartEventLoop();
-    void StopEventLoop();
+    friend class HttpResponse;
+    friend class BatchResponse;
+    friend int  OnRequestHeader( evhttp_request *, void * );
+    friend void OnRequestWritten( evbuffer *, const evbuffer_cb_info *, void * );
+
+    void               Submit( const HttpRequest &request, SSLConfig *ssl_config, HttpResponse *response );
+    BatchResponse::Ptr SubmitBatch( const std::vector<HttpRequest> &requests, SSLConfig *ssl_config );
+    void               Prepare( EventLoop *loop, const HttpRequest &request, SSLConfig *ssl_config,
+                                HttpResponse *response ) const;
+    EventLoop        *SelectLoop( const HttpRequest &request ) const;
+    // false when the request was queued, it is then dispatched once a finished request hands over its slot
+    bool               Admit( HttpResponse *response );
+    // true when a fresh entry finished response, otherwise a stale one may be left for revalidation
+    bool               ServeFromCache( const HttpRequest &request, HttpResponse *response ) const;
+    // the response to send request for, response itself when not coalesced, nullptr when it waits for one in flight
+    HttpResponse      *Coalesce( EventLoop *loop, const HttpRequest &request, SSLConfig *ssl_config,
+                                 HttpResponse *response ) const;
+
+    // loop thread only
+    static void               Dispatch( HttpResponse *response );
+    static void               MakeRequest( HttpResponse *response, evhttp_connection *connection );
+    static void               Fail( HttpResponse *response, const std::string &error );
+    static evhttp_connection *CreateConnection( event_base *base, const std::string &address,
+                                                const HttpRequest &request, SSLConfig *ssl_config );
+    static void               Cancel( HttpResponse *response );
+    static void               Abort( HttpResponse *response, const std::string &error );
+    static void               ArmTimer( HttpResponse *response );
+    static void               CheckDeadlines( HttpResponse *response );
+    static void               StartAttempt( HttpResponse *response );
+    static void               OnAttemptDone( HttpResponse *response, HttpResponse::Ptr attempt );
+    static void               UpdateCache( HttpResponse *response );
+    static void               FillFromCache( HttpResponse *response, const CachedResponse &entry );
+    static void               OnFlightDone( RequestCoalescer *coalescer, const std::string &key,
+                                            HttpResponse::Ptr flight );
+    // start of the idle read deadline, now while a body stream holds reads
+    static HttpResponse::Clock::time_point IdleSince( const HttpResponse *response );
 
-    event_base      *base_ = nullptr;
-    std::thread      worker_;
-    std::atomic_bool running_ = false;
+    HttpClientOptions                       options_;
+    std::unique_ptr<RetryBudget>            retry_budget_;
+    std::unique_ptr<RequestLimiter>         limiter_;    // only with limits set, outlives the loops
+    std::unique_ptr<ResponseCache>          cache_;      // only with cache set
+    std::unique_ptr<RequestCoalescer>       coalescer_;  // only with coalesce set
+    std::vector<std::unique_ptr<EventLoop>> loops_;
 };
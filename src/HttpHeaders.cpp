@@ -0,0 +1,120 @@
+#include "HttpHeaders.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+char ToLower( char c ) {
+    return ( c >= 'A' && c <= 'Z' ) ? static_cast<char>( c - 'A' + 'a' ) : c;
+}
+
+}  // namespace
+
+HttpHeaders::HttpHeaders( std::initializer_list<Field> fields ) {
+    for ( auto &field : fields ) {
+        Add( field.name, field.value );
+    }
+}
+
+HttpHeaders::HttpHeaders( const std::map<std::string, std::string> &fields ) {
+    for ( auto &[name, value] : fields ) {
+        Add( name, value );
+    }
+}
+
+HttpHeaders::HttpHeaders( HttpHeaders &&other ) noexcept : fields_( std::exchange( other.fields_, {} ) ) {}
+
+HttpHeaders &HttpHeaders::operator=( HttpHeaders &&other ) noexcept {
+    fields_ = std::exchange( other.fields_, {} );
+    return *this;
+}
+
+bool HttpHeaders::EqualsIgnoreCase( std::string_view a, std::string_view b ) {
+    if ( a.size() != b.size() ) {
+        return false;
+    }
+    for ( size_t i = 0; i < a.size(); ++i ) {
+        if ( ToLower( a[i] ) != ToLower( b[i] ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HttpHeaders::Add( std::string name, std::string value ) {
+    if ( fields_.capacity() == 0 ) {
+        fields_.reserve( kReservedFields );
+    }
+    fields_.push_back( Field{ std::move( name ), std::move( value ) } );
+}
+
+void HttpHeaders::Set( const std::string &name, std::string value ) {
+    auto first = std::find_if( fields_.begin(), fields_.end(),
+                               [&name]( const Field &field ) { return EqualsIgnoreCase( field.name, name ); } );
+    if ( first != fields_.end() ) {
+        first->value = std::move( value );
+        // drop later duplicates, the first field keeps its position
+        std::string_view key( first->name );
+        fields_.erase( std::remove_if( first + 1, fields_.end(),
+                                       [key]( const Field &field ) { return EqualsIgnoreCase( field.name, key ); } ),
+                       fields_.end() );
+        return;
+    }
+    Add( name, std::move( value ) );
+}
+
+size_t HttpHeaders::Remove( std::string_view name ) {
+    auto   last    = std::remove_if( fields_.begin(), fields_.end(),
+                                     [name]( const Field &field ) { return EqualsIgnoreCase( field.name, name ); } );
+    size_t removed = static_cast<size_t>( fields_.end() - last );
+    fields_.erase( last, fields_.end() );
+    return removed;
+}
+
+void HttpHeaders::Clear() {
+    fields_.clear();
+}
+
+bool HttpHeaders::Contains( std::string_view name ) const {
+    return Find( name ) != nullptr;
+}
+
+const std::string *HttpHeaders::Find( std::string_view name ) const {
+    for ( auto &field : *this ) {
+        if ( EqualsIgnoreCase( field.name, name ) ) {
+            return &field.value;
+        }
+    }
+    return nullptr;
+}
+
+std::string HttpHeaders::Get( std::string_view name ) const {
+    auto *value = Find( name );
+    return value != nullptr ? *value : "";
+}
+
+std::vector<std::string> HttpHeaders::GetAll( std::string_view name ) const {
+    std::vector<std::string> values;
+    for ( auto &field : *this ) {
+        if ( EqualsIgnoreCase( field.name, name ) ) {
+            values.push_back( field.value );
+        }
+    }
+    return values;
+}
+
+size_t HttpHeaders::Size() const {
+    return fields_.size();
+}
+
+bool HttpHeaders::Empty() const {
+    return fields_.empty();
+}
+
+HttpHeaders::const_iterator HttpHeaders::begin() const {
+    return fields_.data();
+}
+
+HttpHeaders::const_iterator HttpHeaders::end() const {
+    return fields_.data() + fields_.size();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Ordered list of HTTP header fields with case-insensitive names
+ * Fields are stored contiguously in insertion order, in one allocation with room for kReservedFields made by the first
+ * Add(). Moving leaves the source empty.
+ * Repeated fields such as Set-Cookie are kept, Get() returns the first of them and GetAll() every one.
+ */
+class HttpHeaders final {
+public:
+    struct Field {
+        std::string name;
+        std::string value;
+    };
+    using const_iterator = const Field *;
+
+    static constexpr size_t kReservedFields = 16;
+
+    HttpHeaders() = default;
+    HttpHeaders( std::initializer_list<Field> fields );
+    HttpHeaders( const std::map<std::string, std::string> &fields );
+    HttpHeaders( const HttpHeaders & ) = default;
+    HttpHeaders( HttpHeaders &&other ) noexcept;
+    HttpHeaders &operator=( const HttpHeaders & ) = default;
+    HttpHeaders &operator=( HttpHeaders &&other ) noexcept;
+
+    static bool EqualsIgnoreCase( std::string_view a, std::string_view b );
+
+    // append a field, keeping fields of the same name
+    void Add( std::string name, std::string value );
+    // replace every field of the same name
+    void   Set( const std::string &name, std::string value );
+    size_t Remove( std::string_view name );
+    void   Clear();
+
+    bool                     Contains( std::string_view name ) const;
+    const std::string       *Find( std::string_view name ) const;  // first value, nullptr if missing
+    std::string              Get( std::string_view name ) const;   // first value, empty if missing
+    std::vector<std::string> GetAll( std::string_view name ) const;
+
+    size_t         Size() const;
+    bool           Empty() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    std::vector<Field> fields_;
+};
@@ -0,0 +1,187 @@
+#include "HttpMetrics.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+const char *const kErrorNames[kRequestErrors]  = { "dns",    "connection", "timeout", "protocol",
+                                                   "decode", "cancelled",  "rejected" };
+const char *const kStatusNames[kStatusClasses] = { "none", "1xx", "2xx", "3xx", "4xx", "5xx" };
+
+// both label values and JSON strings, host keys rarely need it
+std::string Escape( const std::string &value ) {
+    std::string escaped;
+    escaped.reserve( value.size() );
+    for ( char c : value ) {
+        if ( c == '\\' || c == '"' ) {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if ( c == '\n' ) {
+            escaped += "\\n";
+        }
+        else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string Seconds( int64_t us ) {
+    char buf[32];
+    std::snprintf( buf, sizeof( buf ), "%g", us / 1e6 );
+    return buf;
+}
+
+}  // namespace
+
+std::string MetricsSnapshot::ToPrometheus() const {
+    std::string out;
+    auto counter = [&]( const char *name, const char *help, const char *type, auto value ) {
+        out += std::string( "# HELP http_client_" ) + name + " " + help + "\n";
+        out += std::string( "# TYPE http_client_" ) + name + " " + type + "\n";
+        for ( auto &[host, metrics] : hosts ) {
+            out += std::string( "http_client_" ) + name + "{host=\"" + Escape( host ) + "\"} " +
+                   std::to_string( value( metrics ) ) + "\n";
+        }
+    };
+    counter( "requests_total", "Requests done.", "counter", []( const HostMetrics &m ) { return m.requests; } );
+    counter( "retries_total", "Extra attempts of retried and hedged requests.", "counter",
+             []( const HostMetrics &m ) { return m.retries; } );
+    counter( "received_bytes_total", "Response body bytes received.", "counter",
+             []( const HostMetrics &m ) { return m.bytes_in; } );
+    counter( "sent_bytes_total", "Request body bytes sent.", "counter",
+             []( const HostMetrics &m ) { return m.bytes_out; } );
+    counter( "in_flight_requests", "Requests started and not done.", "gauge",
+             []( const HostMetrics &m ) { return m.in_flight; } );
+    counter( "pool_hits_total", "Requests sent on a pooled connection.", "counter",
+             []( const HostMetrics &m ) { return m.pool_hits; } );
+    counter( "pool_misses_total", "Requests that opened a connection.", "counter",
+             []( const HostMetrics &m ) { return m.pool_misses; } );
+
+    out += "# HELP http_client_errors_total Requests without a response, by kind.\n";
+    out += "# TYPE http_client_errors_total counter\n";
+    for ( auto &[host, metrics] : hosts ) {
+        for ( size_t i = 0; i < kRequestErrors; ++i ) {
+            out += "http_client_errors_total{host=\"" + Escape( host ) + "\",kind=\"" + kErrorNames[i] + "\"} " +
+                   std::to_string( metrics.errors[i] ) + "\n";
+        }
+    }
+
+    out += "# HELP http_client_request_duration_seconds From Send to done, by status class.\n";
+    out += "# TYPE http_client_request_duration_seconds histogram\n";
+    for ( auto &[host, metrics] : hosts ) {
+        for ( size_t i = 0; i < kStatusClasses; ++i ) {
+            auto &histogram = metrics.latency[i];
+            if ( histogram.count == 0 ) {
+                continue;
+            }
+            auto     labels     = "host=\"" + Escape( host ) + "\",status=\"" + kStatusNames[i] + "\"";
+            uint64_t cumulative = 0;
+            for ( size_t b = 0; b < histogram.buckets.size(); ++b ) {
+                cumulative += histogram.buckets[b];
+                auto le = b < LatencyHistogram::kBoundsUs.size() ? Seconds( LatencyHistogram::kBoundsUs[b] ) : "+Inf";
+                out += "http_client_request_duration_seconds_bucket{" + labels + ",le=\"" + le + "\"} " +
+                       std::to_string( cumulative ) + "\n";
+            }
+            out += "http_client_request_duration_seconds_sum{" + labels + "} " + Seconds( histogram.sum_us ) + "\n";
+            out += "http_client_request_duration_seconds_count{" + labels + "} " + std::to_string( histogram.count ) +
+                   "\n";
+        }
+    }
+    return out;
+}
+
+std::string MetricsSnapshot::ToJson() const {
+    std::string out = "{\"hosts\":{";
+    bool        first_host = true;
+    for ( auto &[host, metrics] : hosts ) {
+        out += ( first_host ? "\"" : ",\"" ) + Escape( host ) + "\":{";
+        first_host = false;
+        out += "\"requests\":" + std::to_string( metrics.requests );
+        out += ",\"retries\":" + std::to_string( metrics.retries );
+        out += ",\"bytes_in\":" + std::to_string( metrics.bytes_in );
+        out += ",\"bytes_out\":" + std::to_string( metrics.bytes_out );
+        out += ",\"in_flight\":" + std::to_string( metrics.in_flight );
+        out += ",\"pool_hits\":" + std::to_string( metrics.pool_hits );
+        out += ",\"pool_misses\":" + std::to_string( metrics.pool_misses );
+        out += ",\"errors\":{";
+        for ( size_t i = 0; i < kRequestErrors; ++i ) {
+            out += std::string( i == 0 ? "\"" : ",\"" ) + kErrorNames[i] + "\":" + std::to_string( metrics.errors[i] );
+        }
+        out += "},\"latency\":{";
+        bool first_class = true;
+        for ( size_t i = 0; i < kStatusClasses; ++i ) {
+            auto &histogram = metrics.latency[i];
+            if ( histogram.count == 0 ) {
+                continue;
+            }
+            out += std::string( first_class ? "\"" : ",\"" ) + kStatusNames[i] + "\":{";
+            first_class = false;
+            out += "\"count\":" + std::to_string( histogram.count ) + ",\"sum_us\":" + std::to_string( histogram.sum_us );
+            out += ",\"buckets\":[";
+            for ( size_t b = 0; b < histogram.buckets.size(); ++b ) {
+                out += ( b == 0 ? "" : "," ) + std::to_string( histogram.buckets[b] );
+            }
+            out += "]}";
+        }
+        out += "}}";
+    }
+    out += "},\"bucket_bounds_us\":[";
+    for ( size_t b = 0; b < LatencyHistogram::kBoundsUs.size(); ++b ) {
+        out += ( b == 0 ? "" : "," ) + std::to_string( LatencyHistogram::kBoundsUs[b] );
+    }
+    out += "]}";
+    return out;
+}
+
+void HttpMetrics::Host::Add( std::atomic<uint64_t> &counter, uint64_t n ) {
+    counter.fetch_add( n, std::memory_order_relaxed );
+}
+
+void HttpMetrics::Host::AddLatency( int status_code, std::chrono::microseconds elapsed ) {
+    size_t status_class = status_code >= 100 && status_code < 600 ? status_code / 100 : 0;
+    auto  &histogram    = latency[status_class];
+    auto  &bounds       = LatencyHistogram::kBoundsUs;
+    size_t bucket       = std::lower_bound( bounds.begin(), bounds.end(), elapsed.count() ) - bounds.begin();
+    histogram.buckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+    histogram.sum_us.fetch_add( elapsed.count(), std::memory_order_relaxed );
+}
+
+HttpMetrics::Host *HttpMetrics::Get( const std::string &key ) {
+    // only the loop thread changes the table, so it can look up without the lock
+    auto it = hosts_.find( key );
+    if ( it != hosts_.end() ) {
+        return it->second.get();
+    }
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return hosts_.emplace( key, std::make_unique<Host>() ).first->second.get();
+}
+
+void HttpMetrics::Collect( MetricsSnapshot &snapshot ) const {
+    auto load = []( auto &value ) { return value.load( std::memory_order_relaxed ); };
+    std::lock_guard<std::mutex> lock( mutex_ );
+    for ( auto &[key, host] : hosts_ ) {
+        auto &metrics = snapshot.hosts[key];
+        metrics.requests += load( host->requests );
+        metrics.retries += load( host->retries );
+        metrics.bytes_in += load( host->bytes_in );
+        metrics.bytes_out += load( host->bytes_out );
+        metrics.in_flight += load( host->in_flight );
+        metrics.pool_hits += load( host->pool_hits );
+        metrics.pool_misses += load( host->pool_misses );
+        for ( size_t i = 0; i < kRequestErrors; ++i ) {
+            metrics.errors[i] += load( host->errors[i] );
+        }
+        for ( size_t i = 0; i < kStatusClasses; ++i ) {
+            auto &from = host->latency[i];
+            auto &to   = metrics.latency[i];
+            for ( size_t b = 0; b < to.buckets.size(); ++b ) {
+                auto count = load( from.buckets[b] );
+                to.buckets[b] += count;
+                to.count += count;
+            }
+            to.sum_us += load( from.sum_us );
+        }
+    }
+}
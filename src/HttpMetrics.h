@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// why a request got no response
+enum class RequestError
+{
+    Dns,         // host could not be resolved
+    Connection,  // not connected, or the connection failed before the response was complete
+    Timeout,     // one of the HttpTimeouts passed
+    Protocol,    // malformed or oversized response
+    Decode,      // corrupt or truncated compressed body
+    Cancelled,
+    Rejected,    // the limiter queue was full, see LimitOptions
+};
+
+constexpr size_t kRequestErrors = 7;
+// latency is kept per status class: 0 for requests without a response, then 1xx to 5xx
+constexpr size_t kStatusClasses = 6;
+
+struct LatencyHistogram {
+    // bucket upper bounds, the last bucket takes the rest
+    static constexpr std::array<int64_t, 13> kBoundsUs = { 1000,   2500,   5000,    10000,   25000,   50000,   100000,
+                                                           250000, 500000, 1000000, 2500000, 5000000, 10000000 };
+
+    std::array<uint64_t, kBoundsUs.size() + 1> buckets = {};  // not cumulative
+    uint64_t                                   count   = 0;
+    int64_t                                    sum_us  = 0;
+};
+
+struct HostMetrics {
+    uint64_t                                     requests    = 0;   // done, a retried request counts once
+    uint64_t                                     retries     = 0;   // extra attempts, hedges included
+    uint64_t                                     bytes_in    = 0;   // response bodies as received
+    uint64_t                                     bytes_out   = 0;   // request bodies as sent
+    int64_t                                      in_flight   = 0;
+    uint64_t                                     pool_hits   = 0;   // sent on a pooled connection
+    uint64_t                                     pool_misses = 0;   // opened a connection
+    std::array<uint64_t, kRequestErrors>         errors      = {};  // by RequestError
+    std::array<LatencyHistogram, kStatusClasses> latency;           // by status class
+};
+
+/**
+ * @brief Client metrics at one point in time, see HttpClient::Metrics()
+ */
+struct MetricsSnapshot {
+    std::map<std::string, HostMetrics> hosts;  // by scheme://host:port
+
+    // Prometheus text exposition format, metric names start with http_client_
+    std::string ToPrometheus() const;
+    std::string ToJson() const;
+};
+
+/**
+ * @brief Counters and latency histograms of the requests run on one event loop, per host
+ * Only the loop thread writes, with relaxed atomics, so recording never takes a lock or contends with another loop.
+ * The host table is locked only to add a host and to collect a snapshot from another thread. Each caller of a
+ * coalesced request counts as a request, the request sent for them only for retries, pool and bytes. Fresh responses
+ * from the cache never reach a loop and are not counted.
+ */
+class HttpMetrics final {
+public:
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, LatencyHistogram::kBoundsUs.size() + 1> buckets = {};
+        std::atomic<int64_t>                                                      sum_us  = 0;
+    };
+
+    struct Host {
+        std::atomic<uint64_t>                             requests    = 0;
+        std::atomic<uint64_t>                             retries     = 0;
+        std::atomic<uint64_t>                             bytes_in    = 0;
+        std::atomic<uint64_t>                             bytes_out   = 0;
+        std::atomic<int64_t>                              in_flight   = 0;
+        std::atomic<uint64_t>                             pool_hits   = 0;
+        std::atomic<uint64_t>                             pool_misses = 0;
+        std::array<std::atomic<uint64_t>, kRequestErrors> errors      = {};
+        std::array<Histogram, kStatusClasses>             latency;
+
+        static void Add( std::atomic<uint64_t> &counter, uint64_t n = 1 );
+        void        AddLatency( int status_code, std::chrono::microseconds elapsed );
+    };
+
+    HttpMetrics() = default;
+    HttpMetrics( const HttpMetrics & )            = delete;
+    HttpMetrics &operator=( const HttpMetrics & ) = delete;
+
+    // loop thread only, the host is created on first use and lives as long as this object
+    Host *Get( const std::string &key );
+
+    // adds the counts of this loop to snapshot, safe to call from any thread
+    void Collect( MetricsSnapshot &snapshot ) const;
+
+private:
+    mutable std::mutex                                     mutex_;
+    std::unordered_map<std::string, std::unique_ptr<Host>> hosts_;
+};
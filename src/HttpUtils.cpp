@@ -1,77 +1,317 @@
 #include "HttpUtils.h"
-#include <event2/http.h>
+#ifdef BUILD_WITH_ZLIB
+    #include <zlib.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <limits>
 #include <string_view>
+#include <utility>
 
-UrlObject::UrlObject( const std::string &url ) : uri_( evhttp_uri_parse( url.c_str() ) ) {}
+namespace {
 
-UrlObject::UrlObject( UrlObject &&other ) {
-    *this = std::move( other );
+// character classes of RFC 3986 2.2, 2.3 and 3.1
+enum CharClass : uint8_t
+{
+    kUnreserved = 1,  // ALPHA / DIGIT / "-" / "." / "_" / "~"
+    kSubDelim   = 2,  // "!" / "$" / "&" / "'" / "(" / ")" / "*" / "+" / "," / ";" / "="
+    kHexDigit   = 4,
+    kSchemeChar = 8,  // ALPHA / DIGIT / "+" / "-" / "."
+    kAlpha      = 16,
+    kDigit      = 32,
+};
+
+constexpr std::array<uint8_t, 256> MakeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    for ( int c = 0; c < 256; ++c ) {
+        bool alpha = ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' );
+        bool digit = c >= '0' && c <= '9';
+        if ( alpha || digit || c == '-' || c == '.' || c == '_' || c == '~' ) {
+            classes[c] |= kUnreserved;
+        }
+        if ( c == '!' || c == '$' || c == '&' || c == '\'' || c == '(' || c == ')' || c == '*' || c == '+' ||
+             c == ',' || c == ';' || c == '=' ) {
+            classes[c] |= kSubDelim;
+        }
+        if ( digit || ( c >= 'a' && c <= 'f' ) || ( c >= 'A' && c <= 'F' ) ) {
+            classes[c] |= kHexDigit;
+        }
+        if ( alpha || digit || c == '+' || c == '-' || c == '.' ) {
+            classes[c] |= kSchemeChar;
+        }
+        classes[c] |= ( alpha ? kAlpha : 0 ) | ( digit ? kDigit : 0 );
+    }
+    return classes;
 }
 
-UrlObject &UrlObject::operator=( UrlObject &&other ) {
-    uri_ = std::exchange( other.uri_, nullptr );
-    return *this;
+constexpr std::array<uint8_t, 256> kCharClasses = MakeCharClasses();
+
+bool Is( char c, uint8_t classes ) {
+    return ( kCharClasses[static_cast<unsigned char>( c )] & classes ) != 0;
 }
 
-UrlObject::~UrlObject() {
-    if ( uri_ != nullptr ) {
-        evhttp_uri_free( uri_ );
+// length of the pct-encoded triplet at pos, 0 if there is none
+size_t PctEncoded( std::string_view s, size_t pos ) {
+    return s[pos] == '%' && pos + 2 < s.size() && Is( s[pos + 1], kHexDigit ) && Is( s[pos + 2], kHexDigit ) ? 3 : 0;
+}
+
+// end of the run of characters from pos that are of classes, one of extra or pct-encoded
+size_t Scan( std::string_view s, size_t pos, uint8_t classes, std::string_view extra ) {
+    while ( pos < s.size() ) {
+        if ( Is( s[pos], classes ) || extra.find( s[pos] ) != std::string_view::npos ) {
+            ++pos;
+        }
+        else if ( size_t n = PctEncoded( s, pos ) ) {
+            pos += n;
+        }
+        else {
+            break;
+        }
     }
+    return pos;
 }
 
-std::optional<std::string> UrlObject::Host() const {
-    if ( uri_ == nullptr ) {
-        return std::nullopt;
+// dec-octet "." dec-octet "." dec-octet "." dec-octet
+bool IsIPv4( std::string_view s ) {
+    size_t pos = 0;
+    for ( int octet = 0; octet < 4; ++octet ) {
+        if ( octet > 0 && ( pos >= s.size() || s[pos++] != '.' ) ) {
+            return false;
+        }
+        size_t start = pos;
+        int    value = 0;
+        while ( pos < s.size() && pos - start < 3 && Is( s[pos], kDigit ) ) {
+            value = value * 10 + ( s[pos++] - '0' );
+        }
+        size_t length = pos - start;
+        if ( length == 0 || value > 255 || ( length > 1 && s[start] == '0' ) ) {
+            return false;
+        }
     }
-    auto *host = evhttp_uri_get_host( uri_ );
-    if ( host == nullptr ) {
-        return std::nullopt;
+    return pos == s.size();
+}
+
+// 8 h16 groups separated by ":", the last two may be an IPv4 address, a run of zero groups may be "::"
+bool IsIPv6( std::string_view s ) {
+    size_t pos    = 0;
+    int    groups = 0;
+    bool   elided = false;
+    if ( s.substr( 0, 2 ) == "::" ) {
+        elided = true;
+        pos    = 2;
     }
-    return std::string( host );
+    while ( pos < s.size() ) {
+        size_t start = pos;
+        while ( pos < s.size() && pos - start < 4 && Is( s[pos], kHexDigit ) ) {
+            ++pos;
+        }
+        if ( pos < s.size() && s[pos] == '.' ) {
+            // ls32 as an IPv4 address, always last
+            if ( !IsIPv4( s.substr( start ) ) ) {
+                return false;
+            }
+            groups += 2;
+            break;
+        }
+        if ( pos == start || ( pos < s.size() && s[pos] != ':' ) ) {
+            return false;
+        }
+        ++groups;
+        if ( pos == s.size() ) {
+            break;
+        }
+        ++pos;
+        if ( pos < s.size() && s[pos] == ':' ) {
+            if ( elided ) {
+                return false;
+            }
+            elided = true;
+            ++pos;
+        }
+        else if ( pos == s.size() ) {
+            return false;
+        }
+    }
+    return elided ? groups <= 7 : groups == 8;
 }
 
-std::optional<uint16_t> UrlObject::Port() const {
-    if ( uri_ == nullptr ) {
-        return std::nullopt;
+// "v" 1*HEXDIG "." 1*( unreserved / sub-delims / ":" )
+bool IsIPvFuture( std::string_view s ) {
+    if ( s.empty() || ( s[0] != 'v' && s[0] != 'V' ) ) {
+        return false;
     }
-    auto port = evhttp_uri_get_port( uri_ );
-    if ( port == -1 ) {
+    size_t pos = 1;
+    while ( pos < s.size() && Is( s[pos], kHexDigit ) ) {
+        ++pos;
+    }
+    if ( pos == 1 || pos + 1 >= s.size() || s[pos] != '.' ) {
+        return false;
+    }
+    for ( ++pos; pos < s.size(); ++pos ) {
+        if ( !Is( s[pos], kUnreserved | kSubDelim ) && s[pos] != ':' ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+UrlObject::UrlObject( std::string_view url ) {
+    valid_ = Parse( url );
+}
+
+UrlObject::UrlObject( const char *url ) : UrlObject( std::string_view( url ) ) {}
+
+bool UrlObject::IsValid() const {
+    return valid_;
+}
+
+std::optional<std::string_view> UrlObject::Scheme() const {
+    if ( !valid_ || !has_scheme_ ) {
         return std::nullopt;
     }
-    return static_cast<uint16_t>( port );
+    return scheme_;
 }
 
-std::optional<std::string> UrlObject::Path() const {
-    if ( uri_ == nullptr ) {
+std::optional<std::string_view> UrlObject::UserInfo() const {
+    if ( !valid_ || !has_user_info_ ) {
         return std::nullopt;
     }
-    auto *path = evhttp_uri_get_path( uri_ );
-    if ( path == nullptr ) {
+    return user_info_;
+}
+
+std::optional<std::string_view> UrlObject::Host() const {
+    if ( !valid_ || !has_host_ ) {
         return std::nullopt;
     }
-    return std::string( path );
+    return host_;
 }
 
-std::optional<std::string> UrlObject::Scheme() const {
-    if ( uri_ == nullptr ) {
+std::optional<uint16_t> UrlObject::Port() const {
+    if ( !valid_ || !has_port_ ) {
         return std::nullopt;
     }
-    auto *scheme = evhttp_uri_get_scheme( uri_ );
-    if ( scheme == nullptr ) {
+    return port_;
+}
+
+std::optional<std::string_view> UrlObject::Path() const {
+    if ( !valid_ ) {
         return std::nullopt;
     }
-    return std::string( scheme );
+    return path_;
 }
 
-std::optional<std::string> UrlObject::Query() const {
-    if ( uri_ == nullptr ) {
+std::optional<std::string_view> UrlObject::Query() const {
+    if ( !valid_ || !has_query_ ) {
         return std::nullopt;
     }
-    auto *query = evhttp_uri_get_query( uri_ );
-    if ( query == nullptr ) {
+    return query_;
+}
+
+std::optional<std::string_view> UrlObject::Fragment() const {
+    if ( !valid_ || !has_fragment_ ) {
         return std::nullopt;
     }
-    return std::string( query );
+    return fragment_;
+}
+
+// URI-reference = URI / relative-ref, RFC 3986 4.1
+bool UrlObject::Parse( std::string_view url ) {
+    // scheme ":", the scheme characters stop at the first colon
+    size_t pos = 0;
+    if ( !url.empty() && Is( url[0], kAlpha ) ) {
+        size_t end = 1;
+        while ( end < url.size() && Is( url[end], kSchemeChar ) ) {
+            ++end;
+        }
+        if ( end < url.size() && url[end] == ':' ) {
+            scheme_     = url.substr( 0, end );
+            has_scheme_ = true;
+            pos         = end + 1;
+        }
+    }
+    // "//" authority, up to the path, query or fragment
+    bool has_authority = url.substr( pos, 2 ) == "//";
+    if ( has_authority ) {
+        pos += 2;
+        size_t end = url.find_first_of( "/?#", pos );
+        end        = end == std::string_view::npos ? url.size() : end;
+        if ( !ParseAuthority( url.substr( pos, end - pos ) ) ) {
+            return false;
+        }
+        pos = end;
+    }
+    // path, then "?" query and "#" fragment, which may also have "?"
+    size_t end = Scan( url, pos, kUnreserved | kSubDelim, ":@/" );
+    path_      = url.substr( pos, end - pos );
+    pos        = end;
+    if ( pos < url.size() && url[pos] == '?' ) {
+        end        = Scan( url, pos + 1, kUnreserved | kSubDelim, ":@/?" );
+        query_     = url.substr( pos + 1, end - pos - 1 );
+        has_query_ = true;
+        pos        = end;
+    }
+    if ( pos < url.size() && url[pos] == '#' ) {
+        end           = Scan( url, pos + 1, kUnreserved | kSubDelim, ":@/?" );
+        fragment_     = url.substr( pos + 1, end - pos - 1 );
+        has_fragment_ = true;
+        pos           = end;
+    }
+    if ( pos != url.size() ) {
+        return false;
+    }
+    // without a scheme the first segment must not have a colon, it would read as one (path-noscheme)
+    if ( !has_scheme_ ) {
+        auto colon = path_.find( ':' );
+        if ( colon != std::string_view::npos && colon < path_.find( '/' ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// authority = [ userinfo "@" ] host [ ":" port ]
+bool UrlObject::ParseAuthority( std::string_view authority ) {
+    has_host_ = true;
+    if ( authority.empty() ) {
+        return true;
+    }
+    auto at = authority.find( '@' );
+    if ( at != std::string_view::npos ) {
+        if ( Scan( authority, 0, kUnreserved | kSubDelim, ":" ) < at ) {
+            return false;
+        }
+        user_info_     = authority.substr( 0, at );
+        has_user_info_ = true;
+        authority.remove_prefix( at + 1 );
+    }
+    // the port is the digits after the last colon, an IPv6 literal ends with "]" instead
+    size_t digits = authority.size();
+    while ( digits > 0 && Is( authority[digits - 1], kDigit ) ) {
+        --digits;
+    }
+    if ( digits > 0 && authority[digits - 1] == ':' ) {
+        if ( digits < authority.size() ) {
+            uint32_t port = 0;
+            for ( char c : authority.substr( digits ) ) {
+                port = port * 10 + static_cast<uint32_t>( c - '0' );
+                if ( port > 65535 ) {
+                    return false;
+                }
+            }
+            port_     = static_cast<uint16_t>( port );
+            has_port_ = true;
+        }
+        authority.remove_suffix( authority.size() - digits + 1 );
+    }
+    host_ = authority;
+    if ( authority.size() >= 2 && authority.front() == '[' && authority.back() == ']' ) {
+        auto literal = authority.substr( 1, authority.size() - 2 );
+        return IsIPv6( literal ) || IsIPvFuture( literal );
+    }
+    // reg-name, which also covers IPv4address
+    return Scan( authority, 0, kUnreserved | kSubDelim, {} ) == authority.size();
 }
 
 std::string JoinQuery( const std::map<std::string, std::string> &query_map, bool with_query_start ) {
@@ -88,7 +328,7 @@ std::string JoinQuery( const std::map<std::string, std::string> &query_map, bool
     return query;
 }
 
-std::map<std::string, std::string> ParseQuery( const std::string &query ) {
+std::map<std::string, std::string> ParseQuery( std::string_view query ) {
     std::map<std::string, std::string> result;
     std::string_view                   qs( query );
     size_t                             start = 0;
@@ -113,3 +353,45 @@ std::map<std::string, std::string> ParseQuery( const std::string &query ) {
     }
     return result;
 }
+
+bool GzipCompress( std::string_view input, std::string &output ) {
+#ifdef BUILD_WITH_ZLIB
+    z_stream stream{};
+    // 16 writes a gzip header instead of a zlib one
+    if ( deflateInit2( &stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) {
+        return false;
+    }
+    constexpr size_t kMaxSlice = std::numeric_limits<uInt>::max();
+    std::string      compressed;
+    size_t           consumed = 0, produced = 0;
+    int              ret      = Z_OK;
+    while ( ret == Z_OK ) {
+        // zlib counts in uInt, larger inputs are fed in slices and only the last one finishes the stream
+        if ( stream.avail_in == 0 && consumed < input.size() ) {
+            size_t slice    = std::min( input.size() - consumed, kMaxSlice );
+            stream.next_in  = reinterpret_cast<Bytef *>( const_cast<char *>( input.data() + consumed ) );
+            stream.avail_in = static_cast<uInt>( slice );
+            consumed += slice;
+        }
+        if ( compressed.size() - produced < 65536 ) {
+            compressed.resize( std::max<size_t>( compressed.size() * 2, 65536 ) );
+        }
+        uInt space       = static_cast<uInt>( std::min( compressed.size() - produced, kMaxSlice ) );
+        stream.next_out  = reinterpret_cast<Bytef *>( &compressed[produced] );
+        stream.avail_out = space;
+        ret              = deflate( &stream, consumed == input.size() ? Z_FINISH : Z_NO_FLUSH );
+        produced += space - stream.avail_out;
+    }
+    deflateEnd( &stream );
+    if ( ret != Z_STREAM_END ) {
+        return false;
+    }
+    compressed.resize( produced );
+    output = std::move( compressed );
+    return true;
+#else
+    (void)input;
+    (void)output;
+    return false;
+#endif
+}
@@ -4,32 +4,73 @@
 #include <map>
 #include <optional>
 #include <string>
+#include <string_view>
 
-struct evhttp_uri;
-
+/**
+ * @brief Components of a URI reference, parsed per RFC 3986 in one pass without allocating
+ * Every component is a view into the parsed string, which must outlive the object. A component that is not in the
+ * string is std::nullopt, one that is but is empty (e.g. the query of "/path?") is an empty view. An invalid string
+ * gives std::nullopt for all of them. As with evhttp_uri_parse(), IP-literal hosts keep their brackets, a port must
+ * fit 16 bits and "host:" has no port.
+ */
 class UrlObject final {
 public:
-    UrlObject( const std::string &url );
-    UrlObject( UrlObject &&other );
-    UrlObject &operator=( UrlObject &&other );
-    UrlObject( const UrlObject & )            = delete;
-    UrlObject &operator=( const UrlObject & ) = delete;
-    ~UrlObject();
+    /**
+     * @brief Parse url, which must outlive this object, as the components are views into it
+     *
+     * @param url
+     */
+    explicit UrlObject( std::string_view url );
+    explicit UrlObject( const char *url );
+    // the components would refer to a string that is gone by the time they are read
+    explicit UrlObject( std::string &&url ) = delete;
+
+    bool IsValid() const;
+
+    std::optional<std::string_view> Scheme() const;
 
-    std::optional<std::string> Host() const;
+    std::optional<std::string_view> UserInfo() const;
+
+    std::optional<std::string_view> Host() const;
 
     std::optional<uint16_t> Port() const;
 
-    std::optional<std::string> Path() const;
+    std::optional<std::string_view> Path() const;  // set for every valid string, empty for e.g. "http://host"
 
-    std::optional<std::string> Scheme() const;
+    std::optional<std::string_view> Query() const;
 
-    std::optional<std::string> Query() const;
+    std::optional<std::string_view> Fragment() const;
 
 private:
-    evhttp_uri *uri_ = nullptr;
+    bool Parse( std::string_view url );
+    bool ParseAuthority( std::string_view authority );
+
+    std::string_view scheme_;
+    std::string_view user_info_;
+    std::string_view host_;
+    std::string_view path_;
+    std::string_view query_;
+    std::string_view fragment_;
+    uint16_t         port_          = 0;
+    bool             valid_         = false;
+    bool             has_scheme_    = false;
+    bool             has_user_info_ = false;
+    bool             has_host_      = false;
+    bool             has_port_      = false;
+    bool             has_query_     = false;
+    bool             has_fragment_  = false;
 };
 
 std::string JoinQuery( const std::map<std::string, std::string> &query_map, bool with_query_start = true );
 
-std::map<std::string, std::string> ParseQuery( const std::string &query );
+std::map<std::string, std::string> ParseQuery( std::string_view query );
+
+/**
+ * @brief gzip input into output
+ * Inputs of any size are compressed, zlib is fed them in slices its 32-bit counters can hold.
+ *
+ * @param input
+ * @param output left unchanged on failure
+ * @return bool false on failure, or always when built without BUILD_WITH_ZLIB
+ */
+bool GzipCompress( std::string_view input, std::string &output );
@@ -0,0 +1,155 @@
+#include "Inflater.h"
+#include <event2/buffer.h>
+#ifdef BUILD_WITH_ZLIB
+    #include <zlib.h>
+#endif
+#include <stdexcept>
+#include "HttpHeaders.h"
+
+#ifndef BUILD_WITH_ZLIB
+// only ever held by a null unique_ptr
+struct z_stream_s {};
+#endif
+
+Inflater::Inflater() {
+    output_ = evbuffer_new();
+    if ( output_ == nullptr ) {
+        throw std::runtime_error( "Failed to create evbuffer" );
+    }
+}
+
+Inflater::~Inflater() {
+#ifdef BUILD_WITH_ZLIB
+    if ( stream_ ) {
+        inflateEnd( stream_.get() );
+    }
+#endif
+    evbuffer_free( output_ );
+}
+
+const char *Inflater::AcceptEncoding() {
+#ifdef BUILD_WITH_ZLIB
+    return "gzip, deflate";
+#else
+    return "";
+#endif
+}
+
+std::unique_ptr<Inflater> Inflater::Create( const std::string &content_encoding ) {
+#ifdef BUILD_WITH_ZLIB
+    bool gzip = HttpHeaders::EqualsIgnoreCase( content_encoding, "gzip" ) ||
+                HttpHeaders::EqualsIgnoreCase( content_encoding, "x-gzip" );
+    if ( !gzip && !HttpHeaders::EqualsIgnoreCase( content_encoding, "deflate" ) ) {
+        return nullptr;
+    }
+    std::unique_ptr<Inflater> inflater( new Inflater() );
+    // 32 detects a gzip or zlib header
+    if ( !inflater->Reset( 15 + 32 ) ) {
+        return nullptr;
+    }
+    inflater->raw_tried_ = gzip;
+    inflater->gzip_      = gzip;
+    return inflater;
+#else
+    (void)content_encoding;
+    return nullptr;
+#endif
+}
+
+bool Inflater::Inflate( evbuffer *input ) {
+#ifdef BUILD_WITH_ZLIB
+    while ( evbuffer_get_length( input ) > 0 ) {
+        if ( finished_ && !NextMember( input ) ) {
+            // trailing garbage after the end of the stream is ignored, another gzip member is not
+            evbuffer_drain( input, evbuffer_get_length( input ) );
+            return true;
+        }
+        evbuffer_iovec in;
+        if ( evbuffer_peek( input, -1, nullptr, &in, 1 ) < 1 ) {
+            return false;
+        }
+        evbuffer_iovec out;
+        if ( evbuffer_reserve_space( output_, 16384, &out, 1 ) < 1 ) {
+            return false;
+        }
+        stream_->next_in   = static_cast<Bytef *>( in.iov_base );
+        stream_->avail_in  = static_cast<uInt>( in.iov_len );
+        stream_->next_out  = static_cast<Bytef *>( out.iov_base );
+        stream_->avail_out = static_cast<uInt>( out.iov_len );
+        int ret            = inflate( stream_.get(), Z_NO_FLUSH );
+        if ( ret == Z_DATA_ERROR && !started_ && !raw_tried_ ) {
+            // "deflate" sent as a raw stream, start over without a header
+            raw_tried_ = true;
+            if ( !Reset( -15 ) ) {
+                return false;
+            }
+            continue;
+        }
+        if ( ret == Z_DATA_ERROR && split_ ) {
+            // the byte that looked like the start of another member was garbage after all
+            split_    = false;
+            finished_ = true;
+            evbuffer_drain( input, evbuffer_get_length( input ) );
+            return true;
+        }
+        if ( ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR ) {
+            return false;
+        }
+        split_      = split_ && stream_->total_in < 2;
+        started_    = true;
+        out.iov_len = out.iov_len - stream_->avail_out;
+        evbuffer_commit_space( output_, &out, 1 );
+        evbuffer_drain( input, in.iov_len - stream_->avail_in );
+        finished_ = ret == Z_STREAM_END;
+    }
+    return true;
+#else
+    (void)input;
+    return false;
+#endif
+}
+
+evbuffer *Inflater::Output() const {
+    return output_;
+}
+
+bool Inflater::Complete() const {
+    return finished_ || !started_ || split_;
+}
+
+bool Inflater::NextMember( evbuffer *input ) {
+#ifdef BUILD_WITH_ZLIB
+    // gzip magic, RFC 1952 2.3.1. A chunk may end after its first byte, inflate then decides on the second one
+    unsigned char magic[2];
+    auto          n = evbuffer_copyout( input, magic, sizeof( magic ) );
+    if ( !gzip_ || n < 1 || magic[0] != 0x1f || ( n > 1 && magic[1] != 0x8b ) ) {
+        return false;
+    }
+    if ( inflateReset2( stream_.get(), 15 + 16 ) != Z_OK ) {
+        return false;
+    }
+    finished_ = false;
+    split_    = n == 1;
+    return true;
+#else
+    (void)input;
+    return false;
+#endif
+}
+
+bool Inflater::Reset( int window_bits ) {
+#ifdef BUILD_WITH_ZLIB
+    if ( stream_ ) {
+        inflateEnd( stream_.get() );
+    }
+    stream_ = std::make_unique<z_stream_s>();
+    if ( inflateInit2( stream_.get(), window_bits ) != Z_OK ) {
+        stream_.reset();
+        return false;
+    }
+    return true;
+#else
+    (void)window_bits;
+    return false;
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+struct evbuffer;
+struct z_stream_s;
+
+/**
+ * @brief Incremental gzip / deflate decoder for response bodies
+ * Input is inflated as it arrives, straight into space reserved in the output evbuffer. A gzip body may consist of
+ * several members one after another (RFC 1952 2.2), which are all inflated. Without BUILD_WITH_ZLIB no encoding is
+ * supported.
+ */
+class Inflater final {
+public:
+    Inflater( const Inflater & )            = delete;
+    Inflater &operator=( const Inflater & ) = delete;
+    ~Inflater();
+
+    // value for the Accept-Encoding request header, empty if nothing is supported
+    static const char *AcceptEncoding();
+
+    /**
+     * @brief Decoder for a Content-Encoding value
+     *
+     * @param content_encoding
+     * @return std::unique_ptr<Inflater> nullptr if the encoding is not supported
+     */
+    static std::unique_ptr<Inflater> Create( const std::string &content_encoding );
+
+    /**
+     * @brief Inflate and drain everything in input
+     *
+     * @param input
+     * @return bool false on corrupt data
+     */
+    bool Inflate( evbuffer *input );
+
+    evbuffer *Output() const;    // inflated data so far, to be drained by the caller
+    bool      Complete() const;  // the stream has ended, or there was no input at all
+
+private:
+    Inflater();
+
+    bool Reset( int window_bits );
+    // starts over for the gzip member that input begins with, false if it does not begin with one
+    bool NextMember( evbuffer *input );
+
+    std::unique_ptr<z_stream_s> stream_;
+    evbuffer                   *output_    = nullptr;
+    bool                        finished_  = false;
+    bool                        started_   = false;  // some input has been inflated
+    bool                        raw_tried_ = false;  // deflate without zlib header, as some servers send it
+    bool                        gzip_      = false;  // Content-Encoding gzip, which may have several members
+    bool                        split_     = false;  // only the first byte of the next member's magic has been seen
+};
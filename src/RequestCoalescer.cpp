@@ -0,0 +1,46 @@
+#include "RequestCoalescer.h"
+#include <algorithm>
+#include <utility>
+
+bool RequestCoalescer::Enabled( const CoalesceOptions &options ) {
+    return options.enabled;
+}
+
+bool RequestCoalescer::Join( const std::string &key, HttpResponse *response ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto [it, first] = flights_.try_emplace( key );
+    it->second.push_back( response );
+    return !first;
+}
+
+std::vector<HttpResponse *> RequestCoalescer::Land( const std::string &key ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto                        it = flights_.find( key );
+    if ( it == flights_.end() ) {
+        return {};
+    }
+    auto waiting = std::move( it->second );
+    flights_.erase( it );
+    return waiting;
+}
+
+bool RequestCoalescer::Leave( const std::string &key, HttpResponse *response ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto                        it = flights_.find( key );
+    if ( it == flights_.end() ) {
+        return false;
+    }
+    auto &waiting = it->second;
+    auto  found   = std::find( waiting.begin(), waiting.end(), response );
+    if ( found == waiting.end() ) {
+        return false;
+    }
+    // the request stays in flight even with nobody waiting, a response it stores in the cache is still of use
+    waiting.erase( found );
+    return true;
+}
+
+size_t RequestCoalescer::InFlight() const {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return flights_.size();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class HttpResponse;
+
+struct CoalesceOptions {
+    bool enabled = false;
+    // request fields whose values must match too, besides scheme, host, port and URI
+    std::vector<std::string> key_fields = { "Accept", "Accept-Encoding", "Accept-Language", "Authorization", "Cookie",
+                                            "Range", "If-None-Match", "If-Modified-Since", "Cache-Control", "Pragma" };
+};
+
+/**
+ * @brief Identical GET requests in flight, shared by all event loops of a client
+ * The first request for a key is sent, the ones made with the same key while it is in flight wait for its response
+ * instead, and each gets a copy of its status and fields sharing one immutable body. With coalescing on, the client
+ * runs every request on the loop of its host as with LoopBalance::HostAffinity, so the callers of a flight share
+ * that loop. All calls take one mutex, which is only held for a map lookup.
+ */
+class RequestCoalescer final {
+public:
+    RequestCoalescer() = default;
+    RequestCoalescer( const RequestCoalescer & )            = delete;
+    RequestCoalescer &operator=( const RequestCoalescer & ) = delete;
+
+    static bool Enabled( const CoalesceOptions &options );
+
+    /**
+     * @brief Wait for the request in flight for key
+     *
+     * @param key
+     * @param response
+     * @return false when there is none, the caller then sends the request and calls Land() once it is done
+     */
+    bool Join( const std::string &key, HttpResponse *response );
+
+    // the responses waiting for key, in the order they joined, the next Join() for key sends again
+    std::vector<HttpResponse *> Land( const std::string &key );
+
+    // take a waiting response out, false if it is not waiting (any more)
+    bool Leave( const std::string &key, HttpResponse *response );
+
+    size_t InFlight() const;
+
+private:
+    mutable std::mutex                                           mutex_;
+    std::unordered_map<std::string, std::vector<HttpResponse *>> flights_;
+};
@@ -0,0 +1,108 @@
+#include "RequestLimiter.h"
+#include <algorithm>
+
+RequestLimiter::RequestLimiter( const LimitOptions &options ) : options_( options ) {}
+
+bool RequestLimiter::Enabled( const LimitOptions &options ) {
+    return options.max_in_flight > 0 || options.max_in_flight_per_host > 0;
+}
+
+RequestLimiter::Admission RequestLimiter::Admit( const std::string &key, HttpResponse *response, bool may_block ) {
+    std::unique_lock<std::mutex> lock( mutex_ );
+    auto                        &host = hosts_[key];
+    // the queue is checked first, a request must not overtake the ones already waiting for its slot
+    if ( MayStart( host ) ) {
+        ++host.in_flight;
+        ++in_flight_;
+        return Admission::Start;
+    }
+    if ( queued_ >= options_.max_queued ) {
+        if ( !may_block || options_.when_full != QueueFullPolicy::Block ) {
+            EraseIdle( hosts_.find( key ) );
+            return Admission::Rejected;
+        }
+        not_full_.wait( lock, [this]() { return queued_ < options_.max_queued; } );
+    }
+    // looked up again, the table may have changed while waiting
+    auto &waiting_host = hosts_[key];
+    if ( MayStart( waiting_host ) ) {
+        ++waiting_host.in_flight;
+        ++in_flight_;
+        return Admission::Start;
+    }
+    waiting_host.waiting.push_back( Waiter{ next_seq_++, response } );
+    ++queued_;
+    return Admission::Queued;
+}
+
+HttpResponse *RequestLimiter::Release( const std::string &key ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto                        it = hosts_.find( key );
+    if ( it == hosts_.end() || it->second.in_flight == 0 ) {
+        return nullptr;
+    }
+    --it->second.in_flight;
+    --in_flight_;
+    // the longest waiting request of any host that has room now
+    auto next = hosts_.end();
+    for ( auto host = hosts_.begin(); host != hosts_.end(); ++host ) {
+        if ( !host->second.waiting.empty() && HasRoom( host->second ) &&
+             ( next == hosts_.end() || host->second.waiting.front().seq < next->second.waiting.front().seq ) ) {
+            next = host;
+        }
+    }
+    if ( next == hosts_.end() ) {
+        EraseIdle( it );
+        return nullptr;
+    }
+    auto *response = next->second.waiting.front().response;
+    next->second.waiting.pop_front();
+    ++next->second.in_flight;
+    ++in_flight_;
+    --queued_;
+    not_full_.notify_one();
+    if ( next != it ) {
+        EraseIdle( it );
+    }
+    return response;
+}
+
+bool RequestLimiter::Remove( const std::string &key, HttpResponse *response ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto                        it = hosts_.find( key );
+    if ( it == hosts_.end() ) {
+        return false;
+    }
+    auto &waiting = it->second.waiting;
+    auto  waiter  = std::find_if( waiting.begin(), waiting.end(),
+                                  [response]( const Waiter &waiter ) { return waiter.response == response; } );
+    if ( waiter == waiting.end() ) {
+        return false;
+    }
+    waiting.erase( waiter );
+    --queued_;
+    not_full_.notify_one();
+    EraseIdle( it );
+    return true;
+}
+
+size_t RequestLimiter::Queued() const {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return queued_;
+}
+
+bool RequestLimiter::MayStart( const Host &host ) const {
+    // requests of other hosts only wait for the client cap, with none set they do not hold this one up
+    return host.waiting.empty() && ( queued_ == 0 || options_.max_in_flight == 0 ) && HasRoom( host );
+}
+
+bool RequestLimiter::HasRoom( const Host &host ) const {
+    return ( options_.max_in_flight == 0 || in_flight_ < options_.max_in_flight ) &&
+           ( options_.max_in_flight_per_host == 0 || host.in_flight < options_.max_in_flight_per_host );
+}
+
+void RequestLimiter::EraseIdle( std::unordered_map<std::string, Host>::iterator it ) {
+    if ( it != hosts_.end() && it->second.in_flight == 0 && it->second.waiting.empty() ) {
+        hosts_.erase( it );
+    }
+}
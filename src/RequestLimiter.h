@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class HttpResponse;
+
+enum class QueueFullPolicy
+{
+    Reject,  // fail the request
+    Block,   // make Send wait for room, requests sent from an event loop thread are failed instead
+};
+
+struct LimitOptions {
+    size_t          max_in_flight          = 0;  // requests per client, 0 for no limit
+    size_t          max_in_flight_per_host = 0;  // requests per (scheme, host, port), 0 for no limit
+    size_t          max_queued             = 65536;  // requests waiting for a slot, per client
+    QueueFullPolicy when_full              = QueueFullPolicy::Reject;
+};
+
+/**
+ * @brief Caps the requests in flight per host and per client, shared by all event loops of a client
+ * Requests over a cap wait in FIFO order until a request finishes. A released slot goes to the longest waiting
+ * request whose host is below its cap. All calls take one mutex, which is only held for a few map lookups.
+ */
+class RequestLimiter final {
+public:
+    enum class Admission
+    {
+        Start,    // holds a slot, start it now
+        Queued,   // returned by Release() once it holds a slot
+        Rejected  // the queue is full
+    };
+
+    explicit RequestLimiter( const LimitOptions &options );
+    RequestLimiter( const RequestLimiter & )            = delete;
+    RequestLimiter &operator=( const RequestLimiter & ) = delete;
+
+    // whether options set any limit
+    static bool Enabled( const LimitOptions &options );
+
+    /**
+     * @brief Take a slot for a request to key, or queue it
+     *
+     * @param key from ConnectionPool::MakeKey()
+     * @param response
+     * @param may_block wait for room in a full queue if the policy says so
+     * @return Admission
+     */
+    Admission Admit( const std::string &key, HttpResponse *response, bool may_block );
+
+    /**
+     * @brief Hand back the slot of a finished request
+     *
+     * @param key
+     * @return HttpResponse* the queued request that got the slot, nullptr if none
+     */
+    HttpResponse *Release( const std::string &key );
+
+    // take a queued request out of the queue, false if it is not queued (any more)
+    bool Remove( const std::string &key, HttpResponse *response );
+
+    size_t Queued() const;
+
+private:
+    struct Waiter {
+        uint64_t      seq = 0;
+        HttpResponse *response = nullptr;
+    };
+
+    struct Host {
+        size_t             in_flight = 0;
+        std::deque<Waiter> waiting;
+    };
+
+    // whether a new request to host may start without queueing
+    bool MayStart( const Host &host ) const;
+    bool HasRoom( const Host &host ) const;
+    void EraseIdle( std::unordered_map<std::string, Host>::iterator it );
+
+    const LimitOptions                    options_;
+    mutable std::mutex                    mutex_;
+    std::condition_variable               not_full_;
+    std::unordered_map<std::string, Host> hosts_;
+    size_t                                in_flight_ = 0;
+    size_t                                queued_    = 0;
+    uint64_t                              next_seq_  = 0;
+};
@@ -0,0 +1,142 @@
+#include "ResponseBody.h"
+#include <event2/buffer.h>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+void ReleaseShared( const void *, size_t, void *extra ) {
+    delete static_cast<std::shared_ptr<const void> *>( extra );
+}
+
+}  // namespace
+
+ResponseBody::ResponseBody( ResponseBody &&other ) noexcept
+    : buffer_( std::exchange( other.buffer_, nullptr ) ),
+      flat_( other.flat_.exchange( nullptr ) ),
+      shared_( std::move( other.shared_ ) ),
+      referred_( std::exchange( other.referred_, std::string_view() ) ),
+      owner_( std::move( other.owner_ ) ) {}
+
+ResponseBody &ResponseBody::operator=( ResponseBody &&other ) noexcept {
+    if ( this != &other ) {
+        if ( buffer_ != nullptr ) {
+            evbuffer_free( buffer_ );
+        }
+        buffer_ = std::exchange( other.buffer_, nullptr );
+        delete flat_.exchange( other.flat_.exchange( nullptr ) );
+        shared_   = std::move( other.shared_ );
+        referred_ = std::exchange( other.referred_, std::string_view() );
+        owner_    = std::move( other.owner_ );
+    }
+    return *this;
+}
+
+ResponseBody::~ResponseBody() {
+    if ( buffer_ != nullptr ) {
+        evbuffer_free( buffer_ );
+    }
+    delete flat_.load();
+}
+
+size_t ResponseBody::Size() const {
+    return buffer_ != nullptr ? evbuffer_get_length( buffer_ ) : 0;
+}
+
+bool ResponseBody::Empty() const {
+    return Size() == 0;
+}
+
+std::vector<std::string_view> ResponseBody::Segments() const {
+    std::vector<std::string_view> segments;
+    if ( buffer_ == nullptr ) {
+        return segments;
+    }
+    int n = evbuffer_peek( buffer_, -1, nullptr, nullptr, 0 );
+    if ( n <= 0 ) {
+        return segments;
+    }
+    std::vector<evbuffer_iovec> vec( n );
+    n = evbuffer_peek( buffer_, -1, nullptr, vec.data(), n );
+    segments.reserve( n );
+    for ( int i = 0; i < n; ++i ) {
+        segments.emplace_back( static_cast<const char *>( vec[i].iov_base ), vec[i].iov_len );
+    }
+    return segments;
+}
+
+const std::string &ResponseBody::String() const {
+    if ( shared_ ) {
+        return *shared_;
+    }
+    if ( auto *flat = flat_.load( std::memory_order_acquire ) ) {
+        return *flat;
+    }
+    // append segment by segment, resize() would zero fill memory that is overwritten right away
+    auto value = std::make_unique<std::string>();
+    value->reserve( Size() );
+    for ( auto segment : Segments() ) {
+        value->append( segment );
+    }
+    // a thread that lost the race returns the copy of the winner
+    std::string *flat = nullptr;
+    if ( flat_.compare_exchange_strong( flat, value.get(), std::memory_order_acq_rel, std::memory_order_acquire ) ) {
+        return *value.release();
+    }
+    return *flat;
+}
+
+void ResponseBody::Take( evbuffer *buffer ) {
+    if ( buffer_ == nullptr ) {
+        buffer_ = evbuffer_new();
+        if ( buffer_ == nullptr ) {
+            throw std::runtime_error( "Failed to create evbuffer" );
+        }
+    }
+    evbuffer_add_buffer( buffer_, buffer );
+    delete flat_.exchange( nullptr );
+    shared_.reset();
+    owner_.reset();
+}
+
+void ResponseBody::Share( std::shared_ptr<const std::string> data ) {
+    Refer( *data, data );
+    shared_ = std::move( data );
+}
+
+void ResponseBody::Refer( std::string_view data, std::shared_ptr<const void> owner ) {
+    if ( buffer_ != nullptr ) {
+        evbuffer_free( std::exchange( buffer_, nullptr ) );
+    }
+    buffer_ = evbuffer_new();
+    if ( buffer_ == nullptr ) {
+        throw std::runtime_error( "Failed to create evbuffer" );
+    }
+    // the buffer holds its own reference until it lets go of the data
+    auto *keep = new std::shared_ptr<const void>( owner );
+    if ( evbuffer_add_reference( buffer_, data.data(), data.size(), ReleaseShared, keep ) != 0 ) {
+        delete keep;
+        throw std::runtime_error( "Failed to add body reference" );
+    }
+    delete flat_.exchange( nullptr );
+    shared_.reset();
+    referred_ = data;
+    owner_    = std::move( owner );
+}
+
+void ResponseBody::ShareWith( ResponseBody &other ) {
+    if ( Empty() ) {
+        other = ResponseBody();
+        return;
+    }
+    if ( !owner_ ) {
+        auto data = std::make_shared<std::string>();
+        data->reserve( Size() );
+        for ( auto segment : Segments() ) {
+            data->append( segment );
+        }
+        Share( std::move( data ) );
+    }
+    other.Refer( referred_, owner_ );
+    other.shared_ = shared_;
+}
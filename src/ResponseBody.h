@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct evbuffer;
+
+/**
+ * @brief Response body kept in the evbuffer chains it was read into
+ * Taking the body from evhttp moves the chains without copying the data. Segments() gives read-only views of the
+ * chains, String() flattens them into one std::string on first use. A body from the response cache refers to the
+ * cached string, which String() then returns as is, or to a mapped file of its disk tier. Coalesced responses share
+ * one body the same way.
+ */
+class ResponseBody final {
+public:
+    ResponseBody() = default;
+    ResponseBody( ResponseBody &&other ) noexcept;
+    ResponseBody &operator=( ResponseBody &&other ) noexcept;
+    ResponseBody( const ResponseBody & )            = delete;
+    ResponseBody &operator=( const ResponseBody & ) = delete;
+    ~ResponseBody();
+
+    size_t Size() const;
+    bool   Empty() const;
+
+    /**
+     * @brief Views of the body in order, valid as long as this body lives
+     *
+     * @return std::vector<std::string_view>
+     */
+    std::vector<std::string_view> Segments() const;
+
+    /**
+     * @brief The whole body as one string, copied once on first call
+     * Threads calling it at the same time may each copy it, one of the copies is kept and returned to all of them.
+     *
+     * @return const std::string&
+     */
+    const std::string &String() const;
+
+private:
+    friend void OnRequestDone( struct evhttp_request *, void * );
+    friend void OnRequestChunk( struct evhttp_request *, void * );
+    friend class HttpClient;
+
+    // moves all data out of buffer, loop thread only
+    void Take( evbuffer *buffer );
+    // refers to all of data without copying, instead of anything taken before
+    void Share( std::shared_ptr<const std::string> data );
+    // same for data kept alive by owner, e.g. a mapped file
+    void Refer( std::string_view data, std::shared_ptr<const void> owner );
+    // makes other refer to this body, copied into a shared string first if it was taken, loop thread only
+    void ShareWith( ResponseBody &other );
+
+    evbuffer                          *buffer_ = nullptr;  // created on first Take()
+    mutable std::atomic<std::string *> flat_   = nullptr;  // made by String(), owned
+    std::shared_ptr<const std::string> shared_;  // set by Share()
+    std::string_view                   referred_;  // set by Refer(), kept alive by owner_
+    std::shared_ptr<const void>        owner_;
+};
@@ -0,0 +1,374 @@
+#include "ResponseCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string_view>
+
+namespace {
+
+// statuses cacheable without explicit permission, RFC 9110 15.1
+constexpr int kCacheableStatus[] = { 200, 203, 204, 300, 301, 308, 404, 405, 410, 414, 501 };
+
+struct CacheControl {
+    bool                   no_store        = false;
+    bool                   no_cache        = false;
+    bool                   is_private      = false;
+    bool                   is_public       = false;
+    bool                   must_revalidate = false;
+    std::optional<int64_t> max_age;
+    std::optional<int64_t> s_maxage;
+};
+
+std::string_view Trim( std::string_view value ) {
+    while ( !value.empty() && ( value.front() == ' ' || value.front() == '\t' ) ) {
+        value.remove_prefix( 1 );
+    }
+    while ( !value.empty() && ( value.back() == ' ' || value.back() == '\t' ) ) {
+        value.remove_suffix( 1 );
+    }
+    return value;
+}
+
+// calls visit with each trimmed, non-empty element of the comma separated lists in values
+void ForEachElement( const std::vector<std::string> &values, const std::function<void( std::string_view )> &visit ) {
+    for ( auto &value : values ) {
+        std::string_view rest = value;
+        while ( !rest.empty() ) {
+            auto comma   = rest.find( ',' );
+            auto element = Trim( rest.substr( 0, comma ) );
+            rest         = comma == std::string_view::npos ? std::string_view() : rest.substr( comma + 1 );
+            if ( !element.empty() ) {
+                visit( element );
+            }
+        }
+    }
+}
+
+std::optional<int64_t> ParseSeconds( std::string_view value ) {
+    value = Trim( value );
+    if ( value.size() >= 2 && value.front() == '"' && value.back() == '"' ) {
+        value = value.substr( 1, value.size() - 2 );
+    }
+    if ( value.empty() || value.size() > 18 ) {
+        return std::nullopt;
+    }
+    int64_t seconds = 0;
+    for ( char c : value ) {
+        if ( c < '0' || c > '9' ) {
+            return std::nullopt;
+        }
+        seconds = seconds * 10 + ( c - '0' );
+    }
+    return seconds;
+}
+
+CacheControl ParseCacheControl( const HttpHeaders &header ) {
+    CacheControl directives;
+    ForEachElement( header.GetAll( "Cache-Control" ), [&directives]( std::string_view element ) {
+        auto equals = element.find( '=' );
+        auto name   = Trim( element.substr( 0, equals ) );
+        if ( HttpHeaders::EqualsIgnoreCase( name, "no-store" ) ) {
+            directives.no_store = true;
+        }
+        else if ( HttpHeaders::EqualsIgnoreCase( name, "no-cache" ) ) {
+            // no-cache="field" is taken as a plain no-cache
+            directives.no_cache = true;
+        }
+        else if ( HttpHeaders::EqualsIgnoreCase( name, "private" ) ) {
+            // private="field" is taken as a plain private
+            directives.is_private = true;
+        }
+        else if ( HttpHeaders::EqualsIgnoreCase( name, "public" ) ) {
+            directives.is_public = true;
+        }
+        else if ( HttpHeaders::EqualsIgnoreCase( name, "must-revalidate" ) ) {
+            directives.must_revalidate = true;
+        }
+        else if ( HttpHeaders::EqualsIgnoreCase( name, "max-age" ) && equals != std::string_view::npos ) {
+            directives.max_age = ParseSeconds( element.substr( equals + 1 ) );
+        }
+        else if ( HttpHeaders::EqualsIgnoreCase( name, "s-maxage" ) && equals != std::string_view::npos ) {
+            directives.s_maxage = ParseSeconds( element.substr( equals + 1 ) );
+        }
+    } );
+    return directives;
+}
+
+// IMF-fixdate only, e.g. "Sun, 06 Nov 1994 08:49:37 GMT", as seconds since the epoch
+std::optional<int64_t> ParseHttpDate( const std::string *value ) {
+    static const char kMonths[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if ( value == nullptr ) {
+        return std::nullopt;
+    }
+    char month[4] = {};
+    int  day = 0, year = 0, hour = 0, minute = 0, second = 0;
+    int  matched =
+        sscanf( value->c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, month, &year, &hour, &minute, &second );
+    if ( matched != 6 || strlen( month ) != 3 ) {
+        return std::nullopt;
+    }
+    const char *found = strstr( kMonths, month );
+    if ( found == nullptr || ( found - kMonths ) % 3 != 0 ) {
+        return std::nullopt;
+    }
+    // days from 1970-01-01 to the civil date, the year starting in March
+    int64_t m    = ( found - kMonths ) / 3 + 1;
+    int64_t y    = year - ( m <= 2 ? 1 : 0 );
+    int64_t era  = y / 400;
+    int64_t yoe  = y - era * 400;
+    int64_t doy  = ( 153 * ( m > 2 ? m - 3 : m + 9 ) + 2 ) / 5 + day - 1;
+    int64_t doe  = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = era * 146097 + doe - 719468;
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+int64_t WallSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>( std::chrono::system_clock::now().time_since_epoch() )
+        .count();
+}
+
+}  // namespace
+
+std::string_view CachedResponse::Body() const {
+    if ( body ) {
+        return *body;
+    }
+    return mapped ? mapped->Data() : std::string_view();
+}
+
+bool CachedResponse::IsFresh( Clock::time_point now ) const {
+    return now < expires;
+}
+
+bool CachedResponse::HasValidator() const {
+    return header.Contains( "ETag" ) || header.Contains( "Last-Modified" );
+}
+
+int64_t CachedResponse::Age( Clock::time_point now ) const {
+    return initial_age + std::chrono::duration_cast<std::chrono::seconds>( now - stored ).count();
+}
+
+size_t CachedResponse::Bytes() const {
+    size_t bytes = sizeof( CachedResponse ) + http_version.size() + status_phrase.size();
+    for ( auto &field : header ) {
+        bytes += field.name.size() + field.value.size();
+    }
+    for ( auto &field : vary ) {
+        bytes += sizeof( field ) + field.name.size() + field.value.size();
+    }
+    return bytes + ( body ? body->size() : 0 );
+}
+
+ResponseCache::ResponseCache( const CacheOptions &options )
+    : shard_count_( std::max<size_t>( options.shards, 1 ) ),
+      shard_budget_( options.max_bytes / shard_count_ ),
+      shards_( new Shard[shard_count_] ),
+      disk_min_body_( options.disk_min_body ) {
+#ifndef _WIN32
+    if ( !options.disk_dir.empty() ) {
+        disk_ = std::make_unique<DiskCache>( options.disk_dir, options.disk_max_bytes );
+    }
+#endif
+}
+
+bool ResponseCache::Enabled( const CacheOptions &options ) {
+    return options.max_bytes > 0;
+}
+
+ResponseCache::Use ResponseCache::UseFor( const HttpHeaders &request_header ) {
+    if ( request_header.Contains( "If-None-Match" ) || request_header.Contains( "If-Modified-Since" ) ||
+         request_header.Contains( "If-Match" ) || request_header.Contains( "If-Unmodified-Since" ) ||
+         request_header.Contains( "If-Range" ) || request_header.Contains( "Range" ) ) {
+        // the caller wants the server's answer to these, not the stored body
+        return Use::Bypass;
+    }
+    auto directives = ParseCacheControl( request_header );
+    if ( directives.no_store ) {
+        return Use::Bypass;
+    }
+    if ( directives.no_cache || directives.max_age == 0 ) {
+        return Use::Revalidate;
+    }
+    if ( !request_header.Contains( "Cache-Control" ) ) {
+        auto pragma = request_header.Find( "Pragma" );
+        if ( pragma != nullptr && HttpHeaders::EqualsIgnoreCase( Trim( *pragma ), "no-cache" ) ) {
+            return Use::Revalidate;
+        }
+    }
+    return Use::Fresh;
+}
+
+std::shared_ptr<CachedResponse> ResponseCache::Make( const HttpHeaders &request_header, int status_code,
+                                                     HttpHeaders header ) {
+    if ( std::find( std::begin( kCacheableStatus ), std::end( kCacheableStatus ), status_code ) ==
+         std::end( kCacheableStatus ) ) {
+        return nullptr;
+    }
+    // the cache is shared by every caller of a client, RFC 9111 5.2.2.7 and 3.5
+    auto directives = ParseCacheControl( header );
+    if ( directives.no_store || directives.is_private ) {
+        return nullptr;
+    }
+    if ( request_header.Contains( "Authorization" ) && !directives.is_public && !directives.s_maxage &&
+         !directives.must_revalidate ) {
+        return nullptr;
+    }
+    auto entry  = std::make_shared<CachedResponse>();
+    bool any    = false;
+    bool cookie = false;
+    ForEachElement( header.GetAll( "Vary" ), [&entry, &any, &cookie, &request_header]( std::string_view name ) {
+        any    = any || name == "*";
+        cookie = cookie || HttpHeaders::EqualsIgnoreCase( name, "Cookie" );
+        entry->vary.push_back( { std::string( name ), request_header.Get( name ) } );
+    } );
+    if ( any ) {
+        // varies on something other than request fields, no request can match it
+        return nullptr;
+    }
+    if ( !cookie && request_header.Contains( "Cookie" ) ) {
+        // a response to one caller's cookies is only ever used for the same cookies, as if it said Vary: Cookie
+        entry->vary.push_back( { "Cookie", request_header.Get( "Cookie" ) } );
+    }
+    // RFC 9111 4.2, the time the request took is left out of the age
+    auto    now        = WallSeconds();
+    auto    date       = ParseHttpDate( header.Find( "Date" ) ).value_or( now );
+    auto    age        = ParseSeconds( header.Get( "Age" ) ).value_or( 0 );
+    int64_t lifetime   = 0;
+    entry->initial_age = std::max( std::max<int64_t>( now - date, 0 ), age );
+    if ( directives.no_cache ) {
+        lifetime = 0;  // revalidated on every use
+    }
+    else if ( directives.s_maxage ) {
+        // RFC 9111 5.2.2.10, for shared caches it overrides max-age
+        lifetime = *directives.s_maxage;
+    }
+    else if ( directives.max_age ) {
+        lifetime = *directives.max_age;
+    }
+    else if ( header.Contains( "Expires" ) ) {
+        // an invalid date, such as "0", means already expired
+        lifetime = ParseHttpDate( header.Find( "Expires" ) ).value_or( date ) - date;
+    }
+    entry->status_code = status_code;
+    entry->header      = std::move( header );
+    entry->stored      = CachedResponse::Clock::now();
+    entry->expires     = entry->stored + std::chrono::seconds( std::max<int64_t>( lifetime - entry->initial_age, 0 ) );
+    if ( !entry->IsFresh( entry->stored ) && !entry->HasValidator() ) {
+        // could only ever be fetched again in full
+        return nullptr;
+    }
+    return entry;
+}
+
+CachedResponse::Ptr ResponseCache::Revalidated( const CachedResponse &stale, const HttpHeaders &request_header,
+                                                const HttpHeaders &not_modified_header ) {
+    // RFC 9111 3.2, the stored fields named in the 304 are replaced, the framing of the stored body is kept
+    HttpHeaders header;
+    for ( auto &field : stale.header ) {
+        if ( !not_modified_header.Contains( field.name ) ||
+             HttpHeaders::EqualsIgnoreCase( field.name, "Content-Length" ) ) {
+            header.Add( field.name, field.value );
+        }
+    }
+    for ( auto &field : not_modified_header ) {
+        if ( !HttpHeaders::EqualsIgnoreCase( field.name, "Content-Length" ) ) {
+            header.Add( field.name, field.value );
+        }
+    }
+    auto entry = Make( request_header, stale.status_code, std::move( header ) );
+    if ( entry ) {
+        entry->http_version  = stale.http_version;
+        entry->status_phrase = stale.status_phrase;
+        entry->body          = stale.body;
+        entry->mapped        = stale.mapped;
+    }
+    return entry;
+}
+
+CachedResponse::Ptr ResponseCache::Find( const std::string &key, const HttpHeaders &request_header ) {
+    auto                        &shard = ShardOf( key );
+    std::unique_lock<std::mutex> lock( shard.mutex );
+    auto                         it = shard.index.find( key );
+    if ( it == shard.index.end() ) {
+        lock.unlock();
+        return disk_ ? disk_->Find( key, request_header ) : nullptr;
+    }
+    auto &entry = it->second->entry;
+    for ( auto &field : entry->vary ) {
+        if ( request_header.Get( field.name ) != field.value ) {
+            return nullptr;
+        }
+    }
+    shard.lru.splice( shard.lru.begin(), shard.lru, it->second );
+    return entry;
+}
+
+void ResponseCache::Store( const std::string &key, CachedResponse::Ptr entry ) {
+    auto bytes = entry->Bytes() + key.size() + sizeof( Node );
+    if ( disk_ && ( entry->mapped || entry->Body().size() >= disk_min_body_ || bytes > shard_budget_ ) ) {
+        EraseMemory( key );
+        disk_->Store( key, std::move( entry ) );
+        return;
+    }
+    if ( disk_ ) {
+        disk_->Erase( key );
+    }
+    auto                       &shard = ShardOf( key );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    auto                        it = shard.index.find( key );
+    if ( it != shard.index.end() ) {
+        shard.bytes -= it->second->bytes;
+        shard.lru.erase( it->second );
+        shard.index.erase( it );
+    }
+    if ( bytes > shard_budget_ ) {
+        return;
+    }
+    while ( shard.bytes + bytes > shard_budget_ ) {
+        auto &oldest = shard.lru.back();
+        shard.bytes -= oldest.bytes;
+        shard.index.erase( oldest.key );
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front( Node{ key, std::move( entry ), bytes } );
+    shard.index.emplace( key, shard.lru.begin() );
+    shard.bytes += bytes;
+}
+
+void ResponseCache::Erase( const std::string &key ) {
+    if ( disk_ ) {
+        disk_->Erase( key );
+    }
+    EraseMemory( key );
+}
+
+void ResponseCache::EraseMemory( const std::string &key ) {
+    auto                       &shard = ShardOf( key );
+    std::lock_guard<std::mutex> lock( shard.mutex );
+    auto                        it = shard.index.find( key );
+    if ( it != shard.index.end() ) {
+        shard.bytes -= it->second->bytes;
+        shard.lru.erase( it->second );
+        shard.index.erase( it );
+    }
+}
+
+size_t ResponseCache::Bytes() const {
+    size_t bytes = 0;
+    for ( size_t i = 0; i < shard_count_; ++i ) {
+        std::lock_guard<std::mutex> lock( shards_[i].mutex );
+        bytes += shards_[i].bytes;
+    }
+    return bytes;
+}
+
+size_t ResponseCache::MaxEntryBytes() const {
+    return disk_ ? std::max( shard_budget_, disk_->MaxBytes() ) : shard_budget_;
+}
+
+ResponseCache::Shard &ResponseCache::ShardOf( const std::string &key ) const {
+    return shards_[std::hash<std::string>()( key ) % shard_count_];
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DiskCache.h"
+#include "HttpHeaders.h"
+
+struct CacheOptions {
+    size_t      max_bytes      = 0;                  // bodies, headers and keys, 0 disables the cache
+    size_t      shards         = 16;                 // each with its own lock and max_bytes / shards of the budget
+    std::string disk_dir;                            // on-disk tier for large bodies, see DiskCache, empty for none
+    size_t      disk_max_bytes = size_t( 1 ) << 30;  // bodies on disk
+    size_t      disk_min_body  = size_t( 1 ) << 20;  // smaller bodies are kept in memory, unless over its budget
+};
+
+/**
+ * @brief A stored response, never changed once in the cache
+ * A revalidated entry is replaced by a new one sharing the same body.
+ */
+struct CachedResponse {
+    using Ptr   = std::shared_ptr<const CachedResponse>;
+    using Clock = std::chrono::steady_clock;
+
+    std::string                        http_version;
+    int                                status_code = 0;
+    std::string                        status_phrase;
+    HttpHeaders                        header;
+    std::shared_ptr<const std::string> body;
+    std::shared_ptr<const MappedFile>  mapped;           // body of an entry from the disk tier, instead of body
+    std::vector<HttpHeaders::Field>    vary;             // request fields named by Vary, as sent, missing ones empty
+    Clock::time_point                  stored;           // response received, or revalidated
+    Clock::time_point                  expires;          // fresh until
+    int64_t                            initial_age = 0;  // seconds, Age as received
+
+    std::string_view Body() const;  // of either tier
+    bool             IsFresh( Clock::time_point now ) const;
+    bool             HasValidator() const;                // ETag or Last-Modified
+    int64_t          Age( Clock::time_point now ) const;  // seconds
+    size_t           Bytes() const;                       // counted against CacheOptions::max_bytes
+};
+
+/**
+ * @brief Sharded LRU of GET responses with a byte budget, freshness from Cache-Control and Expires
+ * A shared cache, as it serves every caller of a client: private responses are not stored, nor responses to requests
+ * with Authorization unless marked public, s-maxage or must-revalidate, and a response to a request with Cookie is
+ * only used for the same Cookie. Every call locks only the shard of its key. There is no heuristic freshness: a
+ * response without max-age or Expires is stored only when it has a validator, and is then revalidated on every use.
+ * With CacheOptions::disk_dir set, large bodies go to a DiskCache instead, which is looked at after the memory tier.
+ */
+class ResponseCache final {
+public:
+    // how a request may use the cache, from its Cache-Control, Pragma and conditional fields
+    enum class Use
+    {
+        Fresh,       // a fresh entry answers it
+        Revalidate,  // no-cache or max-age=0, an entry only saves the body transfer
+        Bypass,      // no-store, or the caller sends conditionals of its own
+    };
+
+    explicit ResponseCache( const CacheOptions &options );
+    ResponseCache( const ResponseCache & )            = delete;
+    ResponseCache &operator=( const ResponseCache & ) = delete;
+
+    static bool Enabled( const CacheOptions &options );
+    static Use  UseFor( const HttpHeaders &request_header );
+
+    /**
+     * @brief New entry for a response, status, header, vary and freshness set
+     *
+     * @param request_header of the request the response was sent for
+     * @param status_code
+     * @param header
+     * @return std::shared_ptr<CachedResponse> nullptr when the response must not or can not usefully be stored
+     */
+    static std::shared_ptr<CachedResponse> Make( const HttpHeaders &request_header, int status_code,
+                                                 HttpHeaders header );
+
+    /**
+     * @brief Entry for stale after a 304, header fields of the 304 replace the stored ones
+     *
+     * @param stale
+     * @param request_header
+     * @param not_modified_header
+     * @return CachedResponse::Ptr nullptr when the merged response is no longer storable
+     */
+    static CachedResponse::Ptr Revalidated( const CachedResponse &stale, const HttpHeaders &request_header,
+                                            const HttpHeaders &not_modified_header );
+
+    // entry for key whose Vary fields match request_header, fresh or not, nullptr if none
+    CachedResponse::Ptr Find( const std::string &key, const HttpHeaders &request_header );
+    // replaces an entry for key in either tier, evicting least recently used ones over the budget
+    void   Store( const std::string &key, CachedResponse::Ptr entry );
+    void   Erase( const std::string &key );
+    size_t Bytes() const;          // memory tier
+    size_t MaxEntryBytes() const;  // larger entries are not stored
+
+private:
+    struct Node {
+        std::string         key;
+        CachedResponse::Ptr entry;
+        size_t              bytes = 0;
+    };
+
+    struct Shard {
+        std::mutex                                                 mutex;
+        std::list<Node>                                            lru;  // most recently used first
+        std::unordered_map<std::string, std::list<Node>::iterator> index;
+        size_t                                                     bytes = 0;
+    };
+
+    Shard &ShardOf( const std::string &key ) const;
+    void   EraseMemory( const std::string &key );
+
+    size_t                     shard_count_;
+    size_t                     shard_budget_;
+    std::unique_ptr<Shard[]>   shards_;
+    size_t                     disk_min_body_ = 0;
+    std::unique_ptr<DiskCache> disk_;
+};
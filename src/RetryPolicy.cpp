@@ -0,0 +1,24 @@
+#include "RetryPolicy.h"
+#include <algorithm>
+
+RetryBudget::RetryBudget( double ratio, int min )
+    : deposit_( static_cast<int64_t>( std::max( ratio, 0.0 ) * kScale ) ),
+      max_( std::max( min, 0 ) * kScale + deposit_ * 1000 ),
+      tokens_( std::max( min, 0 ) * kScale ) {}
+
+void RetryBudget::Deposit() {
+    auto tokens = tokens_.load( std::memory_order_relaxed );
+    while ( tokens < max_ &&
+            !tokens_.compare_exchange_weak( tokens, std::min( tokens + deposit_, max_ ), std::memory_order_relaxed ) ) {
+    }
+}
+
+bool RetryBudget::Withdraw() {
+    auto tokens = tokens_.load( std::memory_order_relaxed );
+    while ( tokens >= kScale ) {
+        if ( tokens_.compare_exchange_weak( tokens, tokens - kScale, std::memory_order_relaxed ) ) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+struct RetryPolicy {
+    int              max_attempts    = 1;     // attempts per request including the first, 1 disables retries
+    int              base_backoff_ms = 50;    // before the second attempt, doubled for each further one
+    int              max_backoff_ms  = 2000;  // backoff is drawn uniformly from [0, min(max, base * 2^n)]
+    std::vector<int> retry_status    = { 502, 503, 504 };  // retried besides connection failures and timeouts
+    int              hedge_after_ms  = 0;  // send a second attempt if the first is still running, e.g. the p95 latency
+    double           budget_ratio    = 0.1;  // retries and hedges allowed per request sent
+    int              budget_min      = 10;   // retries and hedges always allowed on top of the ratio
+};
+
+/**
+ * @brief Limits retries and hedges to a fraction of the requests sent, shared by all event loops of a client
+ * Every request deposits budget_ratio of a token, capped at budget_min plus the ratio of 1000 requests, each retry or
+ * hedge withdraws one. When an upstream is down this keeps retries from multiplying the load on it.
+ */
+class RetryBudget final {
+public:
+    RetryBudget( double ratio, int min );
+
+    void Deposit();
+    bool Withdraw();
+
+private:
+    static constexpr int64_t kScale = 1000;  // tokens are counted in thousandths
+
+    const int64_t        deposit_;
+    const int64_t        max_;
+    std::atomic<int64_t> tokens_;
+};
@@ -12,6 +12,18 @@
 static std::atomic_bool ssl_init_ = false;
 
 namespace {
+
+#ifdef BUILD_WITH_SSL
+// ex data slot holding the "host:port" session cache key of a client SSL
+int SessionKeyIndex() {
+    static int index = SSL_get_ex_new_index(
+        0, nullptr, nullptr, nullptr, []( void *, void *ptr, CRYPTO_EX_DATA *, int, long, void * ) {
+            delete reinterpret_cast<std::string *>( ptr );
+        } );
+    return index;
+}
+#endif
+
 class OpenSSLErrorHandler {
 public:
     static std::string getOpenSSLErrors() {
@@ -39,6 +51,7 @@ SSLConfig::SSLConfig( const std::string &cert_path ) : cert_path_( cert_path ) {
 }
 
 SSLConfig::~SSLConfig() {
+    ClearSessionCache();
     if ( context_ ) {
 #ifdef BUILD_WITH_SSL
         SSL_CTX_free( context_ );
@@ -51,7 +64,7 @@ SSL_CTX *SSLConfig::GetContext() const {
     return context_;
 }
 
-SSL *SSLConfig::CreateSSL( const std::string &host ) {
+SSL *SSLConfig::CreateSSL( const std::string &host, uint16_t port ) {
 #ifdef BUILD_WITH_SSL
     auto *ssl = SSL_new( context_ );
     if ( ssl == nullptr ) {
@@ -62,8 +75,25 @@ SSL *SSLConfig::CreateSSL( const std::string &host ) {
     // Set hostname for SNI extension
     SSL_set_tlsext_host_name( ssl, host.c_str() );
     #endif
+    auto *key = new std::string( host + ":" + std::to_string( port ) );
+    SSL_set_ex_data( ssl, SessionKeyIndex(), key );
+    std::lock_guard<std::mutex> lock( session_mutex_ );
+    auto                        it = sessions_.find( *key );
+    if ( session_cache_enabled_ && it != sessions_.end() ) {
+        auto *session = it->second.session;
+        SSL_set_session( ssl, session );
+    #if OPENSSL_VERSION_NUMBER >= 0x10101000L
+        // TLS 1.3 tickets are single use, the resumed handshake delivers fresh ones
+        if ( SSL_SESSION_get_protocol_version( session ) >= TLS1_3_VERSION ) {
+            SSL_SESSION_free( session );
+            sessions_.erase( it );
+        }
+    #endif
+    }
     return ssl;
 #else
+    (void)host;
+    (void)port;
     return nullptr;
 #endif
 }
@@ -76,11 +106,47 @@ void SSLConfig::FreeSSL( SSL *ssl ) {
 #endif
 }
 
+bool SSLConfig::IsSessionReused( SSL *ssl ) {
+#ifdef BUILD_WITH_SSL
+    return ssl != nullptr && SSL_session_reused( ssl ) == 1;
+#else
+    (void)ssl;
+    return false;
+#endif
+}
+
+void SSLConfig::SetSessionCache( bool enabled, size_t max_sessions ) {
+    {
+        std::lock_guard<std::mutex> lock( session_mutex_ );
+        session_cache_enabled_ = enabled;
+        max_sessions_          = max_sessions;
+    }
+    if ( !enabled ) {
+        ClearSessionCache();
+    }
+}
+
+size_t SSLConfig::SessionCacheSize() const {
+    std::lock_guard<std::mutex> lock( session_mutex_ );
+    return sessions_.size();
+}
+
+void SSLConfig::ClearSessionCache() {
+    std::lock_guard<std::mutex> lock( session_mutex_ );
+#ifdef BUILD_WITH_SSL
+    for ( auto &[key, cached] : sessions_ ) {
+        SSL_SESSION_free( cached.session );
+    }
+#endif
+    sessions_.clear();
+}
+
 void SSLConfig::Init() {
     InitializeOpenSSL();
     CreateContext();
     LoadCertificates();
     SetHostnameValidation();
+    InitSessionCache();
 }
 
 void SSLConfig::InitializeOpenSSL() {
@@ -154,6 +220,56 @@ void SSLConfig::SetHostnameValidation() {
 #endif
 }
 
+void SSLConfig::InitSessionCache() {
+#ifdef BUILD_WITH_SSL
+    // sessions are kept per host by OnNewSession, OpenSSL's own cache is keyed by session id only
+    SSL_CTX_set_app_data( context_, this );
+    SSL_CTX_set_session_cache_mode( context_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+    SSL_CTX_sess_set_new_cb( context_, OnNewSession );
+#endif
+}
+
+int SSLConfig::OnNewSession( SSL *ssl, SSL_SESSION *session ) {
+#ifdef BUILD_WITH_SSL
+    auto *config = reinterpret_cast<SSLConfig *>( SSL_CTX_get_app_data( SSL_get_SSL_CTX( ssl ) ) );
+    auto *key    = reinterpret_cast<std::string *>( SSL_get_ex_data( ssl, SessionKeyIndex() ) );
+    if ( config == nullptr || key == nullptr ) {
+        return 0;
+    }
+    #if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if ( SSL_SESSION_is_resumable( session ) != 1 ) {
+        return 0;
+    }
+    #endif
+    std::lock_guard<std::mutex> lock( config->session_mutex_ );
+    if ( !config->session_cache_enabled_ || config->max_sessions_ == 0 ) {
+        return 0;
+    }
+    auto &cached = config->sessions_[*key];
+    if ( cached.session != nullptr ) {
+        SSL_SESSION_free( cached.session );
+    }
+    cached.session = session;
+    cached.stored  = ++config->session_counter_;
+    if ( config->sessions_.size() > config->max_sessions_ ) {
+        auto oldest = config->sessions_.begin();
+        for ( auto it = config->sessions_.begin(); it != config->sessions_.end(); ++it ) {
+            if ( it->second.stored < oldest->second.stored ) {
+                oldest = it;
+            }
+        }
+        SSL_SESSION_free( oldest->second.session );
+        config->sessions_.erase( oldest );
+    }
+    // keep the reference OpenSSL handed over
+    return 1;
+#else
+    (void)ssl;
+    (void)session;
+    return 0;
+#endif
+}
+
 std::string SSLConfig::SSLErrorString() {
     return OpenSSLErrorHandler::getOpenSSLErrors();
 }
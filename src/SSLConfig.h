@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <string>
 
 struct ssl_ctx_st;
@@ -8,6 +12,9 @@ typedef struct ssl_ctx_st SSL_CTX;
 struct ssl_st;
 typedef struct ssl_st SSL;
 
+struct ssl_session_st;
+typedef struct ssl_session_st SSL_SESSION;
+
 class SSLConfig {
 public:
     explicit SSLConfig();
@@ -16,7 +23,15 @@ public:
 
     SSL_CTX *GetContext() const;
 
-    SSL *CreateSSL( const std::string &host );
+    /**
+     * @brief Create a client SSL for host with SNI set
+     * If the session cache holds a session for host:port, it is attached so the handshake can resume it.
+     *
+     * @param host
+     * @param port
+     * @return SSL*
+     */
+    SSL *CreateSSL( const std::string &host, uint16_t port = 443 );
 
     /**
      * @brief
@@ -30,6 +45,25 @@ public:
 
     static std::string SSLErrorString();
 
+    /**
+     * @brief Whether the handshake of ssl resumed a cached session
+     *
+     * @param ssl
+     */
+    static bool IsSessionReused( SSL *ssl );
+
+    /**
+     * @brief Client session cache, enabled by default
+     * Keeps the latest session per host:port, TLS 1.2 session IDs and tickets are reused until they expire, TLS 1.3
+     * tickets are used once and replaced by the tickets of the resumed handshake.
+     *
+     * @param enabled
+     * @param max_sessions hosts kept, the least recently stored is dropped first
+     */
+    void   SetSessionCache( bool enabled, size_t max_sessions = 256 );
+    size_t SessionCacheSize() const;
+    void   ClearSessionCache();
+
 private:
     void Init();
 
@@ -37,7 +71,21 @@ private:
     void CreateContext();
     void LoadCertificates();
     void SetHostnameValidation();
+    void InitSessionCache();
+
+    static int OnNewSession( SSL *ssl, SSL_SESSION *session );
+
+    struct CachedSession {
+        SSL_SESSION *session = nullptr;
+        uint64_t     stored  = 0;
+    };
 
     std::string cert_path_;
     SSL_CTX    *context_ = nullptr;
+
+    mutable std::mutex                   session_mutex_;
+    bool                                 session_cache_enabled_ = true;
+    size_t                               max_sessions_          = 256;
+    uint64_t                             session_counter_       = 0;
+    std::map<std::string, CachedSession> sessions_;  // host:port
 };
\ No newline at end of file
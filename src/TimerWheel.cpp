@@ -0,0 +1,102 @@
+#include "TimerWheel.h"
+#include <event2/event.h>
+#include <algorithm>
+#include <stdexcept>
+
+TimerWheel::TimerWheel( event_base *base, int tick_ms, size_t slots )
+    : tick_ms_( std::max( tick_ms, 1 ) ), origin_( Clock::now() ), slots_( std::max<size_t>( slots, 1 ) ) {
+    event_ = evtimer_new( base, OnTick, this );
+    if ( event_ == nullptr ) {
+        throw std::runtime_error( "Failed to create timer wheel event" );
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    event_free( event_ );
+}
+
+uint64_t TimerWheel::Add( int delay_ms, Callback callback ) {
+    if ( timers_.empty() ) {
+        // nothing ticked while idle, skip the ticks that passed meanwhile
+        tick_ = CurrentTick();
+    }
+    uint64_t id    = next_id_++;
+    uint64_t ticks = ( static_cast<uint64_t>( std::max( delay_ms, 0 ) ) + tick_ms_ - 1 ) / tick_ms_;
+    // counted from now, the ticks of a stalled loop may not have been processed yet
+    uint64_t tick = std::max( tick_, CurrentTick() ) + std::max<uint64_t>( ticks, 1 );
+    timers_.emplace( id, Timer{ tick, std::move( callback ) } );
+    slots_[tick % slots_.size()].push_back( id );
+    Schedule();
+    return id;
+}
+
+void TimerWheel::Cancel( uint64_t id ) {
+    timers_.erase( id );
+}
+
+size_t TimerWheel::Size() const {
+    return timers_.size();
+}
+
+void TimerWheel::OnTick( int, short, void *arg ) {
+    auto *wheel       = reinterpret_cast<TimerWheel *>( arg );
+    wheel->scheduled_ = false;
+    wheel->Advance();
+    wheel->Schedule();
+}
+
+uint64_t TimerWheel::CurrentTick() const {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( Clock::now() - origin_ ).count();
+    return static_cast<uint64_t>( elapsed ) / tick_ms_;
+}
+
+void TimerWheel::Advance() {
+    uint64_t now = CurrentTick();
+    if ( timers_.empty() ) {
+        // only cancelled ids are left
+        for ( auto &slot : slots_ ) {
+            slot.clear();
+        }
+        tick_ = now;
+        return;
+    }
+    // a full turn visits every slot, more ticks than slots behind need no extra pass
+    uint64_t first = std::max( tick_ + 1, now >= slots_.size() ? now - slots_.size() + 1 : 0 );
+    std::vector<uint64_t> due;
+    for ( uint64_t tick = first; tick <= now; ++tick ) {
+        auto  &slot = slots_[tick % slots_.size()];
+        size_t kept = 0;
+        for ( auto id : slot ) {
+            auto it = timers_.find( id );
+            if ( it == timers_.end() ) {
+                continue;
+            }
+            if ( it->second.tick > now ) {
+                slot[kept++] = id;
+                continue;
+            }
+            due.push_back( id );
+        }
+        slot.resize( kept );
+    }
+    tick_ = std::max( tick_, now );
+    // a callback may cancel timers that are due in the same tick
+    for ( auto id : due ) {
+        auto it = timers_.find( id );
+        if ( it == timers_.end() ) {
+            continue;
+        }
+        auto callback = std::move( it->second.callback );
+        timers_.erase( it );
+        callback();
+    }
+}
+
+void TimerWheel::Schedule() {
+    if ( scheduled_ || timers_.empty() ) {
+        return;
+    }
+    timeval tv{ tick_ms_ / 1000, ( tick_ms_ % 1000 ) * 1000 };
+    evtimer_add( event_, &tv );
+    scheduled_ = true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+struct event_base;
+struct event;
+
+/**
+ * @brief Hashed timing wheel for many coarse timers on one event loop
+ * All timers share a single libevent timer that ticks every tick_ms while any timer is pending, so adding and cancelling
+ * a timer does not touch the event base. Timers fire up to one tick late. Must only be used from the loop thread.
+ */
+class TimerWheel final {
+public:
+    using Callback = std::function<void()>;
+
+    TimerWheel( event_base *base, int tick_ms = 10, size_t slots = 1024 );
+    TimerWheel( const TimerWheel & )            = delete;
+    TimerWheel &operator=( const TimerWheel & ) = delete;
+    ~TimerWheel();
+
+    /**
+     * @brief Run callback once after delay_ms
+     *
+     * @param delay_ms
+     * @param callback
+     * @return uint64_t id for Cancel(), never 0
+     */
+    uint64_t Add( int delay_ms, Callback callback );
+
+    void   Cancel( uint64_t id );
+    size_t Size() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        uint64_t tick = 0;  // fires on the first tick at or after this one
+        Callback callback;
+    };
+
+    static void OnTick( int, short, void *arg );
+
+    uint64_t CurrentTick() const;
+    void     Advance();
+    void     Schedule();
+
+    event                                  *event_ = nullptr;
+    const int                               tick_ms_;
+    Clock::time_point                       origin_;
+    uint64_t                                tick_    = 0;  // last tick processed
+    uint64_t                                next_id_ = 1;
+    bool                                    scheduled_ = false;
+    std::vector<std::vector<uint64_t>>      slots_;  // timer ids, cancelled ones are skipped when their slot is due
+    std::unordered_map<uint64_t, Timer>     timers_;
+};